@@ -0,0 +1,79 @@
+/**
+* the balancing policies side by side: insert, lookup and erase time, and the
+*   average lookup depth, measured as key comparisons per lower_bound
+*   (which makes exactly one comparison per level, down to a nullptr link).
+* keys are inserted in random order and in ascending order.
+*   g++ -O2 -I src bench/balance.cpp -o balance && ./balance [number of keys]
+*/
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+double seconds(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+long long comparisons = 0;
+
+struct counting_less {
+	bool operator()(int a, int b) const {
+		++comparisons;
+		return a < b;
+	}
+};
+
+template<class Balance>
+void run(const char *name, const int *keys, int n) {
+	typedef sjtu::map<int, int, counting_less, Balance> map_type;
+	map_type map;
+	clock_t start = clock();
+	for (int i = 0; i < n; ++i) map[keys[i]] = i;
+	double insert = seconds(start);
+
+	long long hits = 0;
+	start = clock();
+	for (int pass = 0; pass < 3; ++pass)
+		for (int i = 0; i < n; ++i) hits += map.count(keys[i]);
+	double find = seconds(start);
+
+	comparisons = 0;
+	for (int i = 0; i < n; ++i) map.lower_bound(keys[i]);
+	double depth = double(comparisons) / n;
+
+	start = clock();
+	for (int i = 0; i < n; i += 2) map.erase(map.find(keys[i]));
+	for (int i = 0; i < n; i += 2) map[keys[i]] = i;
+	double update = seconds(start);
+
+	if (hits != 3LL * n) printf("lookup failed\n");
+	printf("%-10s insert %.3fs  find %.3fs  erase+insert %.3fs  depth %.2f\n",
+	       name, insert, find, update, depth);
+}
+
+void run_all(const int *keys, int n) {
+	run<sjtu::red_black_balance>("red-black", keys, n);
+	run<sjtu::avl_balance>("avl", keys, n);
+	run<sjtu::wavl_balance>("wavl", keys, n);
+	run<sjtu::aa_balance>("aa", keys, n);
+}
+
+int main(int argc, char **argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000000;
+	int *keys = new int[n];
+	for (int i = 0; i < n; ++i) keys[i] = i;
+
+	printf("ascending keys\n");
+	run_all(keys, n);
+
+	srand(2671);
+	for (int i = n - 1; i > 0; --i) {
+		int j = (int)(((unsigned long long)rand() * RAND_MAX + rand()) % (i + 1));
+		int t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+	}
+	printf("random keys\n");
+	run_all(keys, n);
+
+	delete[] keys;
+	return 0;
+}
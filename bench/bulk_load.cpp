@@ -0,0 +1,43 @@
+/**
+* building a map from unsorted rows with repeated keys: one insert per row
+*   against parallel_bulk_load on every core.
+*   g++ -O2 -pthread -I src bench/bulk_load.cpp -o bulk_load && ./bulk_load [rows]
+*/
+#include "map_parallel.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef sjtu::pair<int, int> row;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+	int rows = argc > 1 ? atoi(argv[1]) : 10000000;
+	std::vector<row> input;
+	input.reserve(rows);
+	unsigned long long state = 2671;
+	for (int i = 0; i < rows; ++i) {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		input.push_back(row((int)((state >> 33) % (unsigned)rows), i));
+	}
+	printf("%d rows, %u hardware threads\n", rows, std::thread::hardware_concurrency());
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		sjtu::map<int, int> m;
+		for (size_t i = 0; i < input.size(); ++i) m.insert(sjtu::map<int, int>::value_type(input[i].first, input[i].second));
+		printf("insert               %.2fs  %zu keys\n", seconds_since(start), m.size());
+	}
+	start = std::chrono::steady_clock::now();
+	{
+		sjtu::map<int, int> m;
+		sjtu::parallel_bulk_load(m, input.begin(), input.end());
+		printf("parallel_bulk_load   %.2fs  %zu keys\n", seconds_since(start), m.size());
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+/**
+* throughput of concurrent_map and sharded_map against sjtu::map behind one std::mutex,
+*   for 1, 2, 4 and 8 threads on a mix of 90% find, 5% insert, 5% erase
+*   over a key range that starts half full.
+* wall-clock time, since the threads run at once; the numbers only mean
+*   something on a machine with at least as many cores as threads.
+*   g++ -O2 -pthread -I src bench/concurrent.cpp -o concurrent && ./concurrent [key range] [operations per thread]
+*/
+#include "concurrent_map.hpp"
+#include "map.hpp"
+#include "sharded_map.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef sjtu::pair<const int, int> value_type;
+
+struct locked_map {
+	std::mutex lock;
+	sjtu::map<int, int> map;
+
+	void insert(int key) {
+		std::lock_guard<std::mutex> hold(lock);
+		map.insert(value_type(key, key));
+	}
+
+	void erase(int key) {
+		std::lock_guard<std::mutex> hold(lock);
+		sjtu::map<int, int>::iterator it = map.find(key);
+		if (it != map.end()) map.erase(it);
+	}
+
+	size_t count(int key) {
+		std::lock_guard<std::mutex> hold(lock);
+		return map.count(key);
+	}
+};
+
+struct lock_free_map {
+	sjtu::concurrent_map<int, int> map;
+
+	void insert(int key) { map.insert(value_type(key, key)); }
+	void erase(int key) { map.erase(key); }
+	size_t count(int key) { return map.count(key); }
+};
+
+struct sharded {
+	sjtu::sharded_map<int, int> map;
+
+	void insert(int key) { map.insert(value_type(key, key)); }
+	void erase(int key) { map.erase(key); }
+	size_t count(int key) { return map.count(key); }
+};
+
+template<class Map>
+double run(int threads, int range, int ops) {
+	Map map;
+	for (int key = 0; key < range; key += 2) map.insert(key);
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int t = 0; t < threads; ++t) {
+		workers.emplace_back([&map, t, range, ops] {
+			unsigned long long state = 2671 + t;
+			size_t hits = 0;
+			for (int i = 0; i < ops; ++i) {
+				state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+				int key = (int)((state >> 33) % range);
+				int dice = (int)((state >> 20) % 100);
+				if (dice < 90) hits += map.count(key);
+				else if (dice < 95) map.insert(key);
+				else map.erase(key);
+			}
+			if (hits == size_t(-1)) printf("unreachable\n");
+		});
+	}
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return double(threads) * ops / seconds / 1e6;
+}
+
+int main(int argc, char **argv) {
+	int range = argc > 1 ? atoi(argv[1]) : 1000000;
+	int ops = argc > 2 ? atoi(argv[2]) : 2000000;
+	printf("%d keys, %d operations per thread, %u hardware threads\n",
+	       range, ops, std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= 8; threads *= 2) {
+		printf("%d threads  mutex map %.2f Mops/s  concurrent_map %.2f Mops/s  sharded_map %.2f Mops/s\n", threads,
+		       run<locked_map>(threads, range, ops), run<lock_free_map>(threads, range, ops),
+		       run<sharded>(threads, range, ops));
+	}
+	return 0;
+}
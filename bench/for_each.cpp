@@ -0,0 +1,55 @@
+/**
+* full traversals: iterator loop vs map::for_each.
+* the map is the one built by data/five (1e6 keys, string values, 31 passes).
+*   g++ -O2 -I src bench/for_each.cpp -o for_each && ./for_each
+*/
+#include "map.hpp"
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+const int N = 1000000;
+const int PASSES = 31;
+
+double seconds(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main() {
+	sjtu::map<int, std::string> map;
+	for (int i = 0; i < N; ++i) map[i] = std::to_string(i);
+
+	size_t sum = 0;
+	clock_t start = clock();
+	for (int pass = 0; pass < PASSES; ++pass) {
+		for (sjtu::map<int, std::string>::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+			sum += it->second.size();
+	}
+	printf("const_iterator loop  %.3fs\n", seconds(start));
+
+	start = clock();
+	for (int pass = 0; pass < PASSES; ++pass) {
+		for (sjtu::map<int, std::string>::iterator it = map.begin(); it != map.end(); ++it)
+			sum += it->second.size();
+	}
+	printf("iterator loop        %.3fs\n", seconds(start));
+
+	start = clock();
+	for (int pass = 0; pass < PASSES; ++pass) {
+		map.for_each([&sum](const sjtu::pair<const int, std::string> &value) {
+			sum += value.second.size();
+		});
+	}
+	printf("for_each             %.3fs\n", seconds(start));
+
+	start = clock();
+	for (int pass = 0; pass < PASSES; ++pass) {
+		map.for_each(N / 4, N / 4 * 3, [&sum](const sjtu::pair<const int, std::string> &value) {
+			sum += value.second.size();
+		});
+	}
+	printf("for_each [n/4, 3n/4) %.3fs\n", seconds(start));
+
+	printf("checksum %zu\n", sum);
+	return 0;
+}
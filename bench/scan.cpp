@@ -0,0 +1,49 @@
+/**
+* in-order traversal of a map much larger than the last-level cache:
+*   iterator loop vs for_each vs the prefetching scan.
+* keys are inserted in random order so that consecutive keys live far apart on the heap.
+*   g++ -O2 -I src bench/scan.cpp -o scan && ./scan [number of keys]
+*/
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+double seconds(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 8000000;
+	int *keys = new int[n];
+	for (int i = 0; i < n; ++i) keys[i] = i;
+	srand(2671);
+	for (int i = n - 1; i > 0; --i) {
+		int j = (int)(((unsigned long long)rand() * RAND_MAX + rand()) % (i + 1));
+		int t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+	}
+	sjtu::map<int, long long> map;
+	for (int i = 0; i < n; ++i) map[keys[i]] = i;
+	delete[] keys;
+
+	const int passes = 5;
+	long long sum = 0;
+	clock_t start = clock();
+	for (int pass = 0; pass < passes; ++pass)
+		for (sjtu::map<int, long long>::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+			sum += it->second;
+	printf("iterator loop %.3fs\n", seconds(start));
+
+	start = clock();
+	for (int pass = 0; pass < passes; ++pass)
+		map.for_each([&sum](const sjtu::pair<const int, long long> &value) { sum += value.second; });
+	printf("for_each      %.3fs\n", seconds(start));
+
+	start = clock();
+	for (int pass = 0; pass < passes; ++pass)
+		map.scan([&sum](const sjtu::pair<const int, long long> &value) { sum += value.second; });
+	printf("scan          %.3fs\n", seconds(start));
+
+	printf("checksum %lld\n", sum);
+	return 0;
+}
@@ -0,0 +1,82 @@
+/**
+* find on a Zipf-distributed key stream: red-black vs splay.
+* key popularity follows 1 / rank^s and hot keys are spread over the key space.
+* the stream is drawn before timing; every lookup is a hit on a non-const map,
+*   so the splay tree moves each key it finds to the root.
+*   g++ -O2 -I src bench/zipf.cpp -o zipf && ./zipf [number of keys] [s]
+*/
+#include "map.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+double seconds(clock_t start) {
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+long long comparisons = 0;
+
+struct counting_less {
+	bool operator()(int a, int b) const {
+		++comparisons;
+		return a < b;
+	}
+};
+
+int random_below(int n) {
+	return (int)(((unsigned long long)rand() * RAND_MAX + rand()) % n);
+}
+
+template<class Balance>
+void run(const char *name, const int *keys, int n, const int *stream, int m) {
+	typedef sjtu::map<int, int, counting_less, Balance> map_type;
+	map_type map;
+	for (int i = 0; i < n; ++i) map[keys[i]] = i;
+
+	long long sum = 0;
+	comparisons = 0;
+	clock_t start = clock();
+	for (int i = 0; i < m; ++i) sum += map.find(stream[i])->second;
+	printf("%-10s find %.3fs  comparisons/find %.2f  (checksum %lld)\n",
+	       name, seconds(start), double(comparisons) / m, sum);
+}
+
+int main(int argc, char **argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000000;
+	double s = argc > 2 ? atof(argv[2]) : 0.99;
+	int m = 10000000;
+
+	int *keys = new int[n];
+	for (int i = 0; i < n; ++i) keys[i] = i;
+	srand(2671);
+	for (int i = n - 1; i > 0; --i) {
+		int j = random_below(i + 1);
+		int t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+	}
+
+	// keys[r] has popularity rank r
+	double *cdf = new double[n];
+	double total = 0;
+	for (int r = 0; r < n; ++r) cdf[r] = total += 1 / pow(r + 1, s);
+	int *stream = new int[m];
+	for (int i = 0; i < m; ++i) {
+		double u = (random_below(1 << 30) + 0.5) / (1 << 30) * total;
+		int lo = 0, hi = n - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (cdf[mid] < u) lo = mid + 1;
+			else hi = mid;
+		}
+		stream[i] = keys[lo];
+	}
+	delete[] cdf;
+
+	printf("%d keys, %d finds, s = %.2f\n", n, m, s);
+	run<sjtu::red_black_balance>("red-black", keys, n, stream, m);
+	run<sjtu::splay_balance>("splay", keys, n, stream, m);
+
+	delete[] stream;
+	delete[] keys;
+	return 0;
+}
@@ -0,0 +1,75 @@
+// a stress test of concurrent_map's erase racing its insert: threads insert,
+//   erase, find and iterate over a few keys at once, so that inserters still
+//   linking a node's upper levels race erasers of the same key, which must
+//   not retire the node before its inserter is done (see release()).
+// values are strings on the heap, so a node freed too early shows up under
+//   AddressSanitizer; anything read back wrong makes it exit non-zero.
+// g++ -std=c++17 -O1 -g -fsanitize=address -pthread code.cpp (answer.txt is its output)
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrent_map.hpp"
+
+typedef sjtu::concurrent_map<int, std::string> map_type;
+
+const int threads = 8;
+const int operations = 100000;  // per thread
+const int keys = 16;
+
+std::string value_of(int key) {
+	return "value of key " + std::to_string(key) + ", long enough to live on the heap";
+}
+
+// the elements in order, each with its own value; returns how many there are
+size_t check_all(const map_type &map, std::atomic<long> &errors) {
+	size_t seen = 0;
+	int last = -1;
+	for (map_type::const_iterator it = map.begin(); it != map.end(); ++it, ++seen) {
+		if (it->first <= last || it->first >= keys || it->second != value_of(it->first)) ++errors;
+		last = it->first;
+	}
+	return seen;
+}
+
+int main() {
+	map_type map;
+	std::atomic<long> errors(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t) {
+		workers.emplace_back([&map, &errors, t] {
+			unsigned long long state = 2671 + t;
+			for (int i = 0; i < operations; ++i) {
+				state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+				int key = (int)((state >> 33) % keys);
+				int dice = (int)((state >> 20) % 100);
+				if (dice < 40) {
+					map.insert(map_type::value_type(key, value_of(key)));
+				} else if (dice < 80) {
+					map.erase(key);
+				} else if (dice < 98) {
+					map_type::const_iterator it = map.find(key);
+					if (it != map.end() && (it->first != key || it->second != value_of(key))) ++errors;
+				} else {
+					check_all(map, errors);
+				}
+			}
+		});
+	}
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+
+	if (check_all(map, errors) != map.size()) ++errors;
+	for (int key = 0; key < keys; ++key) {
+		if (map.count(key) == 0) continue;
+		if (map.erase(key) != 1) ++errors;
+	}
+	if (map.size() != 0 || map.begin() != map.end()) ++errors;
+	if (errors.load() != 0) {
+		printf("FAIL %ld inconsistent reads\n", errors.load());
+		return 1;
+	}
+	puts("concurrent insert, erase, find and iteration: ok");
+	return 0;
+}
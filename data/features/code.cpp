@@ -0,0 +1,444 @@
+// differential and invariant checks for the features beyond std::map:
+//   treap split/join/split_at, flat_map, freeze(), the radix index of integer
+//   keys, the key prefix of std::string keys, inline nodes, parallel_bulk_load.
+// every map is compared with std::map after random operations, and its
+//   internals are checked against what the headers promise.
+// g++ -std=c++17 -O2 -pthread code.cpp (answer.txt is its output)
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iterator>
+#include <new>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <utility>
+// the checks read the trees, so they need the private members
+#define private public
+#include "map.hpp"
+#include "flat_map.hpp"
+#include "frozen_map.hpp"
+#include "map_parallel.hpp"
+#undef private
+#include "rcu_map.hpp"
+
+#define CHECK(c) do { if (!(c)) { printf("FAIL %s line %d\n", #c, __LINE__); exit(1); } } while (0)
+
+unsigned long long seed = 88172645463325252ULL;
+unsigned next_rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return unsigned(seed >> 16);
+}
+
+int int_key(int range) { return int(next_rand() % range); }
+long long long_key(int range) { return (long long)(next_rand() % range) * 1000003LL - 500000LL * 1000003LL; }
+std::string string_key(int range) {
+	// a shared start longer than the inline prefix now and then
+	return std::string(next_rand() % 3 ? "" : "a-shared-start-") + std::to_string(next_rand() % range);
+}
+
+template<class M>
+struct checker {
+	typedef typename M::Node Node;
+	typedef typename M::NodeBase NodeBase;
+
+	static int tree_size(const Node* node) {
+		if (node == nullptr) return 0;
+		return tree_size(node->left) + tree_size(node->right) + 1;
+	}
+
+	// parent links, in-order along the thread, size()
+	static void links(const M& m) {
+		CHECK(m.root == nullptr || m.root->parent == nullptr);
+		CHECK(tree_size(m.root) == int(m.size()));
+		std::vector<const Node*> order;
+		std::vector<const Node*> path;
+		const Node* node = m.root;
+		while (node != nullptr || !path.empty()) {
+			while (node != nullptr) {
+				if (node->left != nullptr) CHECK(node->left->parent == node);
+				if (node->right != nullptr) CHECK(node->right->parent == node);
+				path.push_back(node);
+				node = node->left;
+			}
+			node = path.back();
+			path.pop_back();
+			order.push_back(node);
+			node = node->right;
+		}
+		const NodeBase* at = &m.header;
+		for (size_t i = 0; i < order.size(); ++i) {
+			CHECK(at->next == order[i] && order[i]->prev == at);
+			if (i > 0) CHECK(m.comp(order[i - 1]->data()->first, order[i]->data()->first));
+			at = order[i];
+		}
+		CHECK(at->next == &m.header && m.header.prev == at);
+	}
+
+	// the radix index holds exactly the map's keys once it is active
+	template<class Key>
+	static void radix(const M& m, const std::vector<Key>& probes) {
+		if (!M::radix_type::enabled) return;
+		for (const NodeBase* at = m.header.next; at != &m.header; at = at->next) {
+			const Node* node = static_cast<const Node*>(at);
+			CHECK(m.radix.find(node->data()->first) == (m.radix_active() ? node : nullptr));
+		}
+		for (size_t i = 0; i < probes.size(); ++i) {
+			const Node* node = m.find_node(m.root, probes[i]);
+			CHECK(m.radix.find(probes[i]) == (m.radix_active() ? node : nullptr));
+		}
+	}
+
+	// every node keeps the prefix of its own key
+	static void prefixes(const M& m) {
+		for (const NodeBase* at = m.header.next; at != &m.header; at = at->next) {
+			const Node* node = static_cast<const Node*>(at);
+			typename M::probe_type probe(node->data()->first);
+			CHECK(M::prefix_type::order(probe, *node) == 0);
+		}
+	}
+
+	// inline slots in use are exactly the nodes of this map found in them
+	static void pool(const M& m, const M* other) {
+		size_t owned = 0, used = 0;
+		for (const NodeBase* at = m.header.next; at != &m.header; at = at->next) {
+			const Node* node = static_cast<const Node*>(at);
+			if (m.pool.owns(node)) ++owned;
+			if (other != nullptr) CHECK(!other->pool.owns(node));
+		}
+		for (size_t i = 0; i < 64; ++i)
+			if (m.pool.in_use(i)) ++used;
+		CHECK(owned == used);
+	}
+
+	// heap order on the priorities, rank is the subtree size
+	static int treap(const Node* node) {
+		if (node == nullptr) return 0;
+		if (node->left != nullptr) CHECK(node->left->aux <= node->aux);
+		if (node->right != nullptr) CHECK(node->right->aux <= node->aux);
+		int size = treap(node->left) + treap(node->right) + 1;
+		CHECK(node->rank == size);
+		return size;
+	}
+
+	// no red node under a red one, the same number of black ones on every path
+	static int red_black(const Node* node) {
+		if (node == nullptr) return 1;
+		if (node->rank == 1) {
+			if (node->left != nullptr) CHECK(node->left->rank == 0);
+			if (node->right != nullptr) CHECK(node->right->rank == 0);
+		}
+		int left = red_black(node->left);
+		CHECK(left == red_black(node->right));
+		return left + (node->rank == 0 ? 1 : 0);
+	}
+
+	template<class Key, class T>
+	static void all(const M& m, const std::map<Key, T>& ref, const std::vector<Key>& probes, const M* other = nullptr) {
+		links(m);
+		radix(m, probes);
+		prefixes(m);
+		pool(m, other);
+		CHECK(m.size() == ref.size());
+		typename M::const_iterator it = m.cbegin();
+		for (typename std::map<Key, T>::const_iterator r = ref.begin(); r != ref.end(); ++r, ++it)
+			CHECK(it->first == r->first && it->second == r->second);
+		CHECK(it == m.cend());
+		for (size_t i = 0; i < probes.size(); ++i) CHECK(m.count(probes[i]) == ref.count(probes[i]));
+	}
+};
+
+template<class Key>
+std::vector<Key> probes_of(Key (*gen)(int), int range) {
+	std::vector<Key> probes;
+	for (int i = 0; i < 64; ++i) probes.push_back(gen(range));
+	return probes;
+}
+
+// random inserts and erases on a and ref
+template<class M, class Key>
+void churn(M& a, std::map<Key, int>& ref, Key (*gen)(int), int range, int ops) {
+	for (int i = 0; i < ops; ++i) {
+		Key k = gen(range);
+		if (next_rand() % 3 != 0) {
+			a[k] = i;
+			ref[k] = i;
+		} else {
+			typename M::iterator it = a.find(k);
+			CHECK((it == a.end()) == (ref.count(k) == 0));
+			if (it != a.end()) {
+				a.erase(it);
+				ref.erase(k);
+			}
+		}
+	}
+}
+
+template<class M, class Key>
+void test_split_join(Key (*gen)(int), int range, int rounds) {
+	typedef checker<M> check;
+	for (int round = 0; round < rounds; ++round) {
+		M a, b;
+		std::map<Key, int> ra, rb;
+		std::vector<Key> probes = probes_of(gen, range);
+		churn(a, ra, gen, range, int(next_rand() % 3 == 0 ? next_rand() % 8 : next_rand() % 600));
+		b[gen(range)] = -1;  // replaced by the split
+		if (next_rand() % 2) {
+			Key key = gen(range);
+			a.split(key, b);
+			rb.clear();
+			rb.insert(ra.lower_bound(key), ra.end());
+			ra.erase(ra.lower_bound(key), ra.end());
+		} else {
+			size_t count = next_rand() % (ra.size() + 2);
+			a.split_at(count, b);
+			typename std::map<Key, int>::iterator cut = ra.begin();
+			for (size_t i = 0; i < count && cut != ra.end(); ++i) ++cut;
+			rb.clear();
+			rb.insert(cut, ra.end());
+			ra.erase(cut, ra.end());
+		}
+		check::treap(a.root);
+		check::treap(b.root);
+		check::all(a, ra, probes, &b);
+		check::all(b, rb, probes, &a);
+		if (!ra.empty() && !rb.empty()) {
+			bool thrown = false;
+			try {
+				b.join(a);
+			} catch (sjtu::runtime_error&) {
+				thrown = true;
+			}
+			CHECK(thrown);
+		}
+		// either side may be the larger one, and either may be empty
+		if (next_rand() % 2) {
+			a.join(b);
+			ra.insert(rb.begin(), rb.end());
+			rb.clear();
+			check::treap(a.root);
+			check::all(a, ra, probes, &b);
+			check::all(b, rb, probes, &a);
+		} else {
+			M c;
+			c.join(a);
+			c.join(b);
+			ra.insert(rb.begin(), rb.end());
+			rb.clear();
+			check::treap(c.root);
+			check::all(c, ra, probes, &a);
+			check::all(a, rb, probes, &c);
+			check::all(b, rb, probes, &c);
+		}
+	}
+}
+
+template<class M, class Key>
+void test_red_black(Key (*gen)(int), int range, int rounds) {
+	typedef checker<M> check;
+	for (int round = 0; round < rounds; ++round) {
+		M a;
+		std::map<Key, int> ref;
+		std::vector<Key> probes = probes_of(gen, range);
+		churn(a, ref, gen, range, int(next_rand() % 800));
+		check::red_black(a.root);
+		check::all(a, ref, probes);
+		M b(a);
+		M c;
+		c = b;
+		check::all(b, ref, probes, &a);
+		check::all(c, ref, probes, &b);
+		churn(c, ref, gen, range, 50);
+		check::red_black(c.root);
+		check::all(c, ref, probes);
+		c.clear();
+		ref.clear();
+		check::all(c, ref, probes);
+	}
+}
+
+template<class Key>
+void test_flat_and_frozen(Key (*gen)(int), int range, int rounds) {
+	for (int round = 0; round < rounds; ++round) {
+		sjtu::map<Key, int> m;
+		sjtu::flat_map<Key, int> f;
+		std::map<Key, int> ref;
+		int ops = int(next_rand() % 300);
+		for (int i = 0; i < ops; ++i) {
+			Key k = gen(range);
+			if (next_rand() % 3 != 0) {
+				m[k] = i;
+				f[k] = i;
+				ref[k] = i;
+			} else if (ref.count(k) != 0) {
+				m.erase(m.find(k));
+				f.erase(f.find(k));
+				ref.erase(k);
+			} else {
+				CHECK(f.find(k) == f.end());
+			}
+		}
+		sjtu::frozen_map<Key, int, std::less<Key> > z = m.freeze();
+		sjtu::flat_map<Key, int> g(m);
+		CHECK(f.size() == ref.size() && g.size() == ref.size() && z.size() == ref.size());
+		typename sjtu::flat_map<Key, int>::const_iterator fi = f.cbegin(), gi = g.cbegin();
+		typename sjtu::frozen_map<Key, int, std::less<Key> >::const_iterator zi = z.cbegin();
+		for (typename std::map<Key, int>::iterator r = ref.begin(); r != ref.end(); ++r, ++fi, ++gi, ++zi) {
+			CHECK(fi->first == r->first && fi->second == r->second);
+			CHECK(gi->first == r->first && gi->second == r->second);
+			CHECK(zi->first == r->first && zi->second == r->second);
+		}
+		CHECK(fi == f.cend() && gi == g.cend() && zi == z.cend());
+		for (int i = 0; i < 64; ++i) {
+			Key k = gen(range);
+			typename std::map<Key, int>::iterator r = ref.lower_bound(k);
+			typename sjtu::flat_map<Key, int>::const_iterator fl = f.lower_bound(k);
+			typename sjtu::frozen_map<Key, int, std::less<Key> >::const_iterator zl = z.lower_bound(k);
+			CHECK((r == ref.end()) == (fl == f.cend()) && (r == ref.end()) == (zl == z.cend()));
+			if (r != ref.end()) CHECK(fl->first == r->first && zl->first == r->first);
+			CHECK(f.count(k) == ref.count(k) && z.count(k) == ref.count(k));
+			if (ref.count(k) != 0) CHECK(z.at(k) == ref[k] && f.at(k) == ref[k]);
+		}
+	}
+}
+
+template<class M, class Key>
+void test_bulk_load(Key (*gen)(int), int range, int rounds, sjtu::thread_pool& pool) {
+	typedef checker<M> check;
+	for (int round = 0; round < rounds; ++round) {
+		std::vector<std::pair<Key, int> > rows;
+		std::map<Key, int> ref;
+		int n = int(next_rand() % 3 == 0 ? next_rand() % 10 : next_rand() % 3000);
+		for (int i = 0; i < n; ++i) {
+			rows.push_back(std::pair<Key, int>(gen(range), i));
+			ref.insert(std::pair<Key, int>(rows.back().first, i));  // the first value wins
+		}
+		M m;
+		m[gen(range)] = -1;  // replaced by the load
+		sjtu::parallel_bulk_load(m, rows.begin(), rows.end(), pool);
+		std::vector<Key> probes = probes_of(gen, range);
+		check::red_black(m.root);
+		check::all(m, ref, probes);
+		churn(m, ref, gen, range, 200);
+		check::red_black(m.root);
+		check::all(m, ref, probes);
+	}
+}
+
+// a key that counts its live copies and can be made to throw when copied or compared
+struct fragile {
+	static long live;
+	static int copies_left;  // throw on the copy that takes it to 0; < 0 never
+	int value;
+
+	explicit fragile(int v) : value(v) { ++live; }
+	fragile(const fragile &other) : value(other.value) {
+		if (copies_left > 0 && --copies_left == 0) throw 1;
+		++live;
+	}
+	fragile &operator=(const fragile &) = delete;
+	~fragile() { --live; }
+};
+long fragile::live = 0;
+int fragile::copies_left = -1;
+
+struct fragile_less {
+	static std::atomic<int> calls_left;
+	bool operator()(const fragile &a, const fragile &b) const {
+		if (calls_left.load() > 0 && --calls_left == 0) throw 2;
+		return a.value < b.value;
+	}
+};
+std::atomic<int> fragile_less::calls_left(-1);
+
+// a load that throws part way frees what it made and leaves the map alone
+void test_bulk_load_throws(sjtu::thread_pool& pool) {
+	typedef sjtu::map<fragile, int, fragile_less> M;
+	std::vector<std::pair<fragile, int> > rows;
+	for (int i = 0; i < 2000; ++i) rows.push_back(std::pair<fragile, int>(fragile(int(next_rand() % 1500)), i));
+	for (int round = 0; round < 60; ++round) {
+		M m;
+		m.insert(M::value_type(fragile(-1), -1));
+		if (round % 3 == 0) fragile::copies_left = int(next_rand() % rows.size()) + 1;
+		else if (round % 3 == 1) fragile_less::calls_left = int(next_rand() % (20 * rows.size())) + 1;
+		bool thrown = false;
+		try {
+			sjtu::parallel_bulk_load(m, rows.begin(), rows.end(), pool);
+		} catch (int) {
+			thrown = true;
+		}
+		fragile::copies_left = -1;
+		fragile_less::calls_left = -1;
+		if (round % 3 == 2) CHECK(!thrown);
+		if (thrown) CHECK(m.size() == 1 && m.begin()->first.value == -1);
+		else CHECK(m.size() > 1000 && m.find(fragile(-1)) == m.end());
+		CHECK(fragile::live == long(rows.size() + m.size()));
+	}
+}
+
+// an update that throws part way frees its copies and leaves the published tree alone
+void test_rcu_throws() {
+	sjtu::rcu_map<fragile, int, fragile_less> m;
+	std::map<int, int> ref;
+	for (int round = 0; round < 3000; ++round) {
+		int key = int(next_rand() % 300), op = int(next_rand() % 3);
+		if (next_rand() % 2) fragile::copies_left = int(next_rand() % 12) + 1;
+		else fragile_less::calls_left = int(next_rand() % 20) + 1;
+		try {
+			if (op == 0) CHECK(m.insert(sjtu::pair<const fragile, int>(fragile(key), round)) == (ref.count(key) == 0));
+			else if (op == 1) m.insert_or_assign(fragile(key), round);
+			else CHECK(m.erase(fragile(key)) == ref.count(key));
+			if (op == 0) ref.insert(std::make_pair(key, round));
+			else if (op == 1) ref[key] = round;
+			else ref.erase(key);
+		} catch (int) {
+		}
+		fragile::copies_left = -1;
+		fragile_less::calls_left = -1;
+		std::vector<std::pair<int, int> > seen;
+		m.for_each([&](const sjtu::pair<const fragile, int> &v) { seen.push_back(std::make_pair(v.first.value, v.second)); });
+		std::vector<std::pair<int, int> > want(ref.begin(), ref.end());
+		CHECK(m.size() == ref.size() && seen == want);
+	}
+}
+
+int main() {
+	typedef sjtu::treap_balance treap;
+	typedef sjtu::red_black_balance red_black;
+
+	test_split_join<sjtu::map<int, int, std::less<int>, treap> >(int_key, 2000, 300);
+	test_split_join<sjtu::map<int, int, std::less<int>, treap, 4> >(int_key, 40, 600);
+	test_split_join<sjtu::map<long long, int, std::less<long long>, treap, 2> >(long_key, 5000, 300);
+	test_split_join<sjtu::map<std::string, int, std::less<std::string>, treap, 3> >(string_key, 500, 300);
+	puts("treap split, split_at and join: ok");
+
+	test_red_black<sjtu::map<int, int> >(int_key, 3000, 100);
+	test_red_black<sjtu::map<long long, int> >(long_key, 3000, 100);
+	test_red_black<sjtu::map<int, int, std::less<int>, red_black, 8> >(int_key, 20, 300);
+	test_red_black<sjtu::map<std::string, int, std::less<std::string>, red_black, 5> >(string_key, 400, 100);
+	puts("radix index, key prefixes and inline nodes: ok");
+
+	test_flat_and_frozen(int_key, 500, 100);
+	test_flat_and_frozen(string_key, 500, 100);
+	puts("flat_map and freeze: ok");
+
+	sjtu::thread_pool pool(3);
+	test_bulk_load<sjtu::map<int, int> >(int_key, 4000, 30, pool);
+	test_bulk_load<sjtu::map<std::string, int, std::less<std::string>, red_black, 4> >(string_key, 2000, 30, pool);
+	test_bulk_load_throws(pool);
+	puts("parallel_bulk_load: ok");
+
+	test_rcu_throws();
+	puts("rcu_map updates that throw: ok");
+	return 0;
+}
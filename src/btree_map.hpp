@@ -0,0 +1,706 @@
+/**
+* a container like std::map backed by a B+-tree.
+* same interface, iterator semantics and exceptions as sjtu::map, but keys
+*   are kept in wide nodes, so a lookup touches a few cache lines per level
+*   instead of one node per comparison.
+*/
+#ifndef SJTU_BTREE_MAP_HPP
+#define SJTU_BTREE_MAP_HPP
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>
+   > class btree_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   struct Leaf;
+
+   /**
+  * every element lives in its own Entry, and leaves hold pointers to entries.
+  * splits and merges move the pointers, never the elements, so iterators
+  *   (which point at entries) stay valid until their element is erased.
+  * leaf/slot locate the entry in the tree and are updated whenever it moves.
+    */
+   struct Entry {
+     value_type value;
+     Leaf* leaf;
+     int slot;
+     explicit Entry(const value_type &v) : value(v), leaf(nullptr), slot(0) {}
+   };
+
+  public:
+   /**
+  * see BidirectionalIterator at CppReference for help.
+  *
+  * if there is anything wrong throw invalid_iterator.
+  *     like it = map.begin(); --it;
+  *       or it = map.end(); ++end();
+    */
+   class const_iterator;
+   class iterator {
+      private:
+       friend class btree_map;
+       friend class const_iterator;
+       Entry* entry_;
+       btree_map* owner;
+      public:
+       iterator() : entry_(nullptr), owner(nullptr) {}
+
+       iterator(Entry* e, btree_map* o) : entry_(e), owner(o) {}
+
+       iterator(const iterator &other) : entry_(other.entry_), owner(other.owner) {}
+
+       iterator operator++(int) {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         iterator tmp = *this;
+         entry_ = next_entry(entry_);
+         return tmp;
+       }
+
+       iterator &operator++() {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         entry_ = next_entry(entry_);
+         return *this;
+       }
+
+       iterator operator--(int) {
+         if (owner == nullptr) throw invalid_iterator();
+         iterator tmp = *this;
+         entry_ = owner->prev_entry(entry_);
+         return tmp;
+       }
+
+       iterator &operator--() {
+         if (owner == nullptr) throw invalid_iterator();
+         entry_ = owner->prev_entry(entry_);
+         return *this;
+       }
+
+       value_type &operator*() const {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         return entry_->value;
+       }
+
+       bool operator==(const iterator &rhs) const {
+         return owner == rhs.owner && entry_ == rhs.entry_;
+       }
+
+       bool operator==(const const_iterator &rhs) const {
+         return owner == rhs.owner && entry_ == rhs.entry_;
+       }
+
+       bool operator!=(const iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       bool operator!=(const const_iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       value_type *operator->() const noexcept {
+         return entry_ != nullptr ? &entry_->value : nullptr;
+       }
+   };
+   class const_iterator {
+      private:
+       friend class btree_map;
+       friend class iterator;
+       const Entry* entry_;
+       const btree_map* owner;
+      public:
+       const_iterator() : entry_(nullptr), owner(nullptr) {}
+
+       const_iterator(const Entry* e, const btree_map* o) : entry_(e), owner(o) {}
+
+       const_iterator(const const_iterator &other) : entry_(other.entry_), owner(other.owner) {}
+
+       const_iterator(const iterator &other) : entry_(other.entry_), owner(other.owner) {}
+
+       const_iterator operator++(int) {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         const_iterator tmp = *this;
+         entry_ = next_entry(entry_);
+         return tmp;
+       }
+
+       const_iterator &operator++() {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         entry_ = next_entry(entry_);
+         return *this;
+       }
+
+       const_iterator operator--(int) {
+         if (owner == nullptr) throw invalid_iterator();
+         const_iterator tmp = *this;
+         entry_ = owner->prev_entry(entry_);
+         return tmp;
+       }
+
+       const_iterator &operator--() {
+         if (owner == nullptr) throw invalid_iterator();
+         entry_ = owner->prev_entry(entry_);
+         return *this;
+       }
+
+       const value_type &operator*() const {
+         if (owner == nullptr || entry_ == nullptr) throw invalid_iterator();
+         return entry_->value;
+       }
+
+       bool operator==(const iterator &rhs) const {
+         return owner == rhs.owner && entry_ == rhs.entry_;
+       }
+
+       bool operator==(const const_iterator &rhs) const {
+         return owner == rhs.owner && entry_ == rhs.entry_;
+       }
+
+       bool operator!=(const iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       bool operator!=(const const_iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       const value_type *operator->() const noexcept {
+         return entry_ != nullptr ? &entry_->value : nullptr;
+       }
+   };
+
+  private:
+   /**
+  * keys per node: about 256 bytes of keys (four cache lines), between 8 and 64.
+  * a node has room for one extra key so that insertion can overflow it
+  *   first and split it afterwards.
+    */
+   static const int key_bytes = 256;
+   static const int capacity = sizeof(Key) * 8 >= key_bytes ? 8
+                               : (sizeof(Key) * 64 <= key_bytes ? 64 : int(key_bytes / sizeof(Key)));
+   static const int min_fill = capacity / 2;
+
+   struct Inner;
+
+   /**
+  * keys are stored inline in raw storage, constructed and destroyed one by one,
+  *   so Key needs neither a default constructor nor assignment.
+    */
+   struct Node {
+     Inner* parent;
+     int count;
+     bool is_leaf;
+     alignas(Key) unsigned char key_storage[sizeof(Key) * (capacity + 1)];
+     explicit Node(bool leaf) : parent(nullptr), count(0), is_leaf(leaf) {}
+     Key &key(int i) { return reinterpret_cast<Key*>(key_storage)[i]; }
+     const Key &key(int i) const { return reinterpret_cast<const Key*>(key_storage)[i]; }
+   };
+
+   // leaf: key(i) is a copy of entries[i]->value.first
+   struct Leaf : Node {
+     Entry* entries[capacity + 1];
+     Leaf *prev, *next;
+     Leaf() : Node(true), prev(nullptr), next(nullptr) {}
+   };
+
+   // inner: children[i] holds the keys k with key(i - 1) <= k < key(i)
+   struct Inner : Node {
+     Node* children[capacity + 2];
+     Inner() : Node(false) {}
+   };
+
+   Compare comp;
+   size_t size_;
+   Node* root;
+   Leaf *head, *tail;  // first and last leaf
+
+   static void construct_key(Node* node, int i, const Key &key) { new (&node->key(i)) Key(key); }
+
+   static void move_key(Node* from, int i, Node* to, int j) {
+     new (&to->key(j)) Key(static_cast<Key&&>(from->key(i)));
+     from->key(i).~Key();
+   }
+
+   static void replace_key(Node* node, int i, const Key &key) {
+     node->key(i).~Key();
+     construct_key(node, i, key);
+   }
+
+   static void place_entry(Leaf* leaf, int i, Entry* e) {
+     leaf->entries[i] = e;
+     e->leaf = leaf;
+     e->slot = i;
+   }
+
+   static Entry* next_entry(const Entry* e) {
+     Leaf* leaf = e->leaf;
+     if (e->slot + 1 < leaf->count) return leaf->entries[e->slot + 1];
+     return leaf->next != nullptr ? leaf->next->entries[0] : nullptr;
+   }
+
+   // the entry before e (e == nullptr is end()); throws at begin()
+   Entry* prev_entry(const Entry* e) const {
+     if (e == nullptr) {
+       if (tail == nullptr) throw invalid_iterator();
+       return tail->entries[tail->count - 1];
+     }
+     Leaf* leaf = e->leaf;
+     if (e->slot > 0) return leaf->entries[e->slot - 1];
+     if (leaf->prev == nullptr) throw invalid_iterator();
+     return leaf->prev->entries[leaf->prev->count - 1];
+   }
+
+   // number of keys in node that are not greater than key
+   int upper_index(const Node* node, const Key &key) const {
+     int lo = 0, hi = node->count;
+     while (lo < hi) {
+       int mid = (lo + hi) >> 1;
+       if (comp(key, node->key(mid))) hi = mid;
+       else lo = mid + 1;
+     }
+     return lo;
+   }
+
+   // number of keys in node that are less than key
+   int lower_index(const Node* node, const Key &key) const {
+     int lo = 0, hi = node->count;
+     while (lo < hi) {
+       int mid = (lo + hi) >> 1;
+       if (comp(node->key(mid), key)) lo = mid + 1;
+       else hi = mid;
+     }
+     return lo;
+   }
+
+   Leaf* find_leaf(const Key &key) const {
+     Node* node = root;
+     if (node == nullptr) return nullptr;
+     while (!node->is_leaf) node = static_cast<Inner*>(node)->children[upper_index(node, key)];
+     return static_cast<Leaf*>(node);
+   }
+
+   Entry* find_entry(const Key &key) const {
+     Leaf* leaf = find_leaf(key);
+     if (leaf == nullptr) return nullptr;
+     int i = lower_index(leaf, key);
+     if (i < leaf->count && !comp(key, leaf->key(i))) return leaf->entries[i];
+     return nullptr;
+   }
+
+   Entry* lower_bound_entry(const Key &key) const {
+     Leaf* leaf = find_leaf(key);
+     if (leaf == nullptr) return nullptr;
+     int i = lower_index(leaf, key);
+     if (i < leaf->count) return leaf->entries[i];
+     return leaf->next != nullptr ? leaf->next->entries[0] : nullptr;
+   }
+
+   static int child_index(const Inner* parent, const Node* child) {
+     int i = 0;
+     while (parent->children[i] != child) ++i;
+     return i;
+   }
+
+   void destroy(Node* node) {
+     if (node->is_leaf) {
+       Leaf* leaf = static_cast<Leaf*>(node);
+       for (int i = 0; i < leaf->count; ++i) {
+         leaf->key(i).~Key();
+         delete leaf->entries[i];
+       }
+       delete leaf;
+     } else {
+       Inner* inner = static_cast<Inner*>(node);
+       for (int i = 0; i < inner->count; ++i) inner->key(i).~Key();
+       for (int i = 0; i <= inner->count; ++i) destroy(inner->children[i]);
+       delete inner;
+     }
+   }
+
+   /**
+  * hang right next to left under their common parent, with separator sep;
+  *   splits the parent in turn when that overflows it.
+    */
+   void insert_into_parent(Node* left, const Key &sep, Node* right) {
+     Inner* parent = left->parent;
+     if (parent == nullptr) {
+       parent = new Inner();
+       construct_key(parent, 0, sep);
+       parent->children[0] = left;
+       parent->children[1] = right;
+       parent->count = 1;
+       left->parent = right->parent = parent;
+       root = parent;
+       return;
+     }
+     int j = child_index(parent, left);
+     for (int i = parent->count; i > j; --i) {
+       move_key(parent, i - 1, parent, i);
+       parent->children[i + 1] = parent->children[i];
+     }
+     construct_key(parent, j, sep);
+     parent->children[j + 1] = right;
+     right->parent = parent;
+     if (++parent->count > capacity) split_inner(parent);
+   }
+
+   void split_leaf(Leaf* leaf) {
+     Leaf* right = new Leaf();
+     int keep = leaf->count / 2;
+     for (int i = keep; i < leaf->count; ++i) {
+       move_key(leaf, i, right, i - keep);
+       place_entry(right, i - keep, leaf->entries[i]);
+     }
+     right->count = leaf->count - keep;
+     leaf->count = keep;
+     right->prev = leaf;
+     right->next = leaf->next;
+     if (leaf->next != nullptr) leaf->next->prev = right;
+     else tail = right;
+     leaf->next = right;
+     insert_into_parent(leaf, right->key(0), right);
+   }
+
+   // the middle key moves up, the keys and children after it go to a new node
+   void split_inner(Inner* node) {
+     Inner* right = new Inner();
+     int mid = node->count / 2;
+     for (int i = mid + 1; i < node->count; ++i) move_key(node, i, right, i - mid - 1);
+     for (int i = mid + 1; i <= node->count; ++i) {
+       right->children[i - mid - 1] = node->children[i];
+       node->children[i]->parent = right;
+     }
+     right->count = node->count - mid - 1;
+     node->count = mid;
+     Key up(node->key(mid));
+     node->key(mid).~Key();
+     insert_into_parent(node, up, right);
+   }
+
+   void unlink_leaf(Leaf* leaf) {
+     if (leaf->prev != nullptr) leaf->prev->next = leaf->next;
+     else head = leaf->next;
+     if (leaf->next != nullptr) leaf->next->prev = leaf->prev;
+     else tail = leaf->prev;
+   }
+
+   // drop key(j) and children[j + 1] from an inner node
+   static void remove_from_inner(Inner* node, int j) {
+     node->key(j).~Key();
+     for (int i = j; i + 1 < node->count; ++i) {
+       move_key(node, i + 1, node, i);
+       node->children[i + 1] = node->children[i + 2];
+     }
+     --node->count;
+   }
+
+   // append all of right to left; right is left's next leaf and is deleted
+   void merge_leaves(Leaf* left, Leaf* right) {
+     for (int i = 0; i < right->count; ++i) {
+       move_key(right, i, left, left->count + i);
+       place_entry(left, left->count + i, right->entries[i]);
+     }
+     left->count += right->count;
+     unlink_leaf(right);
+     delete right;
+   }
+
+   void rebalance_leaf(Leaf* leaf) {
+     if (leaf == root) {
+       if (leaf->count == 0) {
+         delete leaf;
+         root = nullptr;
+         head = tail = nullptr;
+       }
+       return;
+     }
+     if (leaf->count >= min_fill) return;
+     Inner* parent = leaf->parent;
+     int j = child_index(parent, leaf);
+     Leaf* left = j > 0 ? static_cast<Leaf*>(parent->children[j - 1]) : nullptr;
+     Leaf* right = j < parent->count ? static_cast<Leaf*>(parent->children[j + 1]) : nullptr;
+     if (left != nullptr && left->count > min_fill) {
+       for (int i = leaf->count; i > 0; --i) {
+         move_key(leaf, i - 1, leaf, i);
+         place_entry(leaf, i, leaf->entries[i - 1]);
+       }
+       --left->count;
+       move_key(left, left->count, leaf, 0);
+       place_entry(leaf, 0, left->entries[left->count]);
+       ++leaf->count;
+       replace_key(parent, j - 1, leaf->key(0));
+     } else if (right != nullptr && right->count > min_fill) {
+       move_key(right, 0, leaf, leaf->count);
+       place_entry(leaf, leaf->count, right->entries[0]);
+       ++leaf->count;
+       for (int i = 1; i < right->count; ++i) {
+         move_key(right, i, right, i - 1);
+         place_entry(right, i - 1, right->entries[i]);
+       }
+       --right->count;
+       replace_key(parent, j, right->key(0));
+     } else if (left != nullptr) {
+       merge_leaves(left, leaf);
+       remove_from_inner(parent, j - 1);
+       rebalance_inner(parent);
+     } else {
+       merge_leaves(leaf, right);
+       remove_from_inner(parent, j);
+       rebalance_inner(parent);
+     }
+   }
+
+   void rebalance_inner(Inner* node) {
+     if (node == root) {
+       if (node->count == 0) {
+         root = node->children[0];
+         root->parent = nullptr;
+         delete node;
+       }
+       return;
+     }
+     if (node->count >= min_fill) return;
+     Inner* parent = node->parent;
+     int j = child_index(parent, node);
+     Inner* left = j > 0 ? static_cast<Inner*>(parent->children[j - 1]) : nullptr;
+     Inner* right = j < parent->count ? static_cast<Inner*>(parent->children[j + 1]) : nullptr;
+     if (left != nullptr && left->count > min_fill) {
+       // rotate right through the parent's separator
+       for (int i = node->count; i > 0; --i) move_key(node, i - 1, node, i);
+       for (int i = node->count + 1; i > 0; --i) node->children[i] = node->children[i - 1];
+       move_key(parent, j - 1, node, 0);
+       node->children[0] = left->children[left->count];
+       node->children[0]->parent = node;
+       ++node->count;
+       --left->count;
+       move_key(left, left->count, parent, j - 1);
+     } else if (right != nullptr && right->count > min_fill) {
+       // rotate left through the parent's separator
+       move_key(parent, j, node, node->count);
+       node->children[node->count + 1] = right->children[0];
+       node->children[node->count + 1]->parent = node;
+       ++node->count;
+       move_key(right, 0, parent, j);
+       for (int i = 1; i < right->count; ++i) move_key(right, i, right, i - 1);
+       for (int i = 0; i < right->count; ++i) right->children[i] = right->children[i + 1];
+       --right->count;
+     } else {
+       // merge: left part, separator, right part
+       Inner* a = left != nullptr ? left : node;
+       Inner* b = left != nullptr ? node : right;
+       int sep = left != nullptr ? j - 1 : j;
+       construct_key(a, a->count, parent->key(sep));
+       for (int i = 0; i < b->count; ++i) move_key(b, i, a, a->count + 1 + i);
+       for (int i = 0; i <= b->count; ++i) {
+         a->children[a->count + 1 + i] = b->children[i];
+         b->children[i]->parent = a;
+       }
+       a->count += b->count + 1;
+       delete b;
+       remove_from_inner(parent, sep);
+       rebalance_inner(parent);
+     }
+   }
+
+   void copy_from(const btree_map &other) {
+     for (Leaf* leaf = other.head; leaf != nullptr; leaf = leaf->next)
+       for (int i = 0; i < leaf->count; ++i) insert(leaf->entries[i]->value);
+   }
+
+   template<class F, class V>
+   static auto visit(F& f, V& value, int) -> decltype(bool(f(value))) { return bool(f(value)); }
+
+   template<class F, class V>
+   static bool visit(F& f, V& value, long) {
+     f(value);
+     return true;
+   }
+
+  public:
+   btree_map() : size_(0), root(nullptr), head(nullptr), tail(nullptr) {}
+
+   btree_map(const btree_map &other) : size_(0), root(nullptr), head(nullptr), tail(nullptr) {
+     copy_from(other);
+   }
+
+   btree_map &operator=(const btree_map &other) {
+     if (this != &other) {
+       clear();
+       copy_from(other);
+     }
+     return *this;
+   }
+
+   ~btree_map() { clear(); }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a reference to the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T &at(const Key &key) {
+     Entry* e = find_entry(key);
+     if (e == nullptr) throw index_out_of_bound();
+     return e->value.second;
+   }
+
+   const T &at(const Key &key) const {
+     Entry* e = find_entry(key);
+     if (e == nullptr) throw index_out_of_bound();
+     return e->value.second;
+   }
+
+   /**
+  * access specified element
+  * Returns a reference to the value that is mapped to a key equivalent to key,
+  *   performing an insertion if such key does not already exist.
+    */
+   T &operator[](const Key &key) {
+     Entry* e = find_entry(key);
+     if (e != nullptr) return e->value.second;
+     value_type val(key, T());
+     return insert(val).first->second;
+   }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const {
+     return at(key);
+   }
+
+   iterator begin() { return iterator(head != nullptr ? head->entries[0] : nullptr, this); }
+
+   const_iterator cbegin() const { return const_iterator(head != nullptr ? head->entries[0] : nullptr, this); }
+
+   iterator end() { return iterator(nullptr, this); }
+
+   const_iterator cend() const { return const_iterator(nullptr, this); }
+
+   bool empty() const { return size_ == 0; }
+
+   size_t size() const { return size_; }
+
+   void clear() {
+     if (root != nullptr) destroy(root);
+     root = nullptr;
+     head = tail = nullptr;
+     size_ = 0;
+   }
+
+   /**
+  * insert an element.
+  * return a pair, the first of the pair is
+  *   the iterator to the new element (or the element that prevented the insertion),
+  *   the second one is true if insert successfully, or false.
+    */
+   pair<iterator, bool> insert(const value_type &value) {
+     Leaf* leaf = find_leaf(value.first);
+     int i = 0;
+     if (leaf != nullptr) {
+       i = lower_index(leaf, value.first);
+       if (i < leaf->count && !comp(value.first, leaf->key(i)))
+         return pair<iterator, bool>(iterator(leaf->entries[i], this), false);
+     }
+     Entry* e = new Entry(value);
+     if (leaf == nullptr) {
+       leaf = new Leaf();
+       root = head = tail = leaf;
+     }
+     for (int j = leaf->count; j > i; --j) {
+       move_key(leaf, j - 1, leaf, j);
+       place_entry(leaf, j, leaf->entries[j - 1]);
+     }
+     construct_key(leaf, i, value.first);
+     place_entry(leaf, i, e);
+     if (++leaf->count > capacity) split_leaf(leaf);
+     ++size_;
+     return pair<iterator, bool>(iterator(e, this), true);
+   }
+
+   /**
+  * erase the element at pos.
+  *
+  * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+    */
+   void erase(iterator pos) {
+     if (pos.owner != this || pos.entry_ == nullptr) throw invalid_iterator();
+     Entry* e = pos.entry_;
+     Leaf* leaf = e->leaf;
+     leaf->key(e->slot).~Key();
+     for (int i = e->slot + 1; i < leaf->count; ++i) {
+       move_key(leaf, i, leaf, i - 1);
+       place_entry(leaf, i - 1, leaf->entries[i]);
+     }
+     --leaf->count;
+     delete e;
+     --size_;
+     rebalance_leaf(leaf);
+   }
+
+   /**
+  * Returns the number of elements with key
+  *   that compares equivalent to the specified argument,
+  *   which is either 1 or 0
+  *     since this container does not allow duplicates.
+    */
+   size_t count(const Key &key) const {
+     return find_entry(key) != nullptr ? 1 : 0;
+   }
+
+   iterator find(const Key &key) {
+     return iterator(find_entry(key), this);
+   }
+
+   const_iterator find(const Key &key) const {
+     return const_iterator(find_entry(key), this);
+   }
+
+   /**
+  * the first element whose key is not less than key, or end().
+    */
+   iterator lower_bound(const Key &key) {
+     return iterator(lower_bound_entry(key), this);
+   }
+
+   const_iterator lower_bound(const Key &key) const {
+     return const_iterator(lower_bound_entry(key), this);
+   }
+
+   /**
+  * apply f to every element in key order, leaf by leaf.
+  * as with sjtu::map::for_each, a visitor returning false stops early and
+  *   makes for_each return false; f must not insert or erase.
+    */
+   template<class F>
+   bool for_each(F f) {
+     for (Leaf* leaf = head; leaf != nullptr; leaf = leaf->next)
+       for (int i = 0; i < leaf->count; ++i)
+         if (!visit(f, leaf->entries[i]->value, 0)) return false;
+     return true;
+   }
+
+   template<class F>
+   bool for_each(F f) const {
+     for (Leaf* leaf = head; leaf != nullptr; leaf = leaf->next)
+       for (int i = 0; i < leaf->count; ++i) {
+         const value_type &value = leaf->entries[i]->value;
+         if (!visit(f, value, 0)) return false;
+       }
+     return true;
+   }
+};
+
+}
+
+#endif
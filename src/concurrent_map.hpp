@@ -0,0 +1,381 @@
+/**
+* a lock-free ordered map for sharing between threads: a skip list in the
+*   style of Fraser and of Herlihy and Shavit.
+* every node is linked into the bottom list and into a random number of the
+*   lists above it, each of which skips more nodes. a link's lowest bit marks
+*   its node as deleted at that level: erase marks a node's links from the top
+*   down, and marking the bottom one is what removes the element. marked nodes
+*   are unlinked by whichever search passes them. a node is retired (see
+*   epoch.hpp) only once both its inserter has stopped linking it and its
+*   eraser has marked it: whichever of the two comes last runs one more search
+*   to unlink it everywhere, then retires it.
+*/
+#ifndef SJTU_CONCURRENT_MAP_HPP
+#define SJTU_CONCURRENT_MAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+* insert, erase, find, count and lower_bound may be called from any number
+*   of threads at once; each of them is atomic. iteration is weakly
+*   consistent: it never fails and visits keys in increasing order, and an
+*   element inserted or erased while it runs may or may not be seen.
+* elements are immutable once inserted; erase and insert again to change one.
+* an iterator pins its thread (see epoch_guard) for as long as it exists, so
+*   it must stay on the thread that made it, and holding one for a long time
+*   delays the freeing of erased nodes everywhere.
+* Compare is called concurrently and must be safe for that.
+* the constructor and the destructor must not race with anything.
+*/
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>
+   > class concurrent_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   static const int max_height = 16;
+
+   /**
+  * a node and its height links are one allocation; the head has no element.
+  * a link is the next node's address, plus one when this node is deleted
+  *   at that level.
+  * owners counts the inserter, until it is done with the upper levels, and
+  *   the eraser, once it has marked them all, see release().
+    */
+   struct alignas(std::atomic<size_t>) Node {
+     alignas(value_type) char storage[sizeof(value_type)];
+     std::atomic<int> owners;
+     int height;
+     std::atomic<size_t>* next() { return reinterpret_cast<std::atomic<size_t>*>(this + 1); }
+     value_type* data() { return reinterpret_cast<value_type*>(storage); }
+     const value_type* data() const { return reinterpret_cast<const value_type*>(storage); }
+   };
+
+   static Node* ptr(size_t link) { return reinterpret_cast<Node*>(link & ~size_t(1)); }
+   static bool marked(size_t link) { return (link & 1) != 0; }
+   static size_t link_to(const Node* node) { return reinterpret_cast<size_t>(node); }
+
+   static Node* make_node(int height) {
+     void* raw = ::operator new(sizeof(Node) + height * sizeof(std::atomic<size_t>));
+     Node* node = new (raw) Node;
+     node->owners.store(2, std::memory_order_relaxed);
+     node->height = height;
+     for (int i = 0; i < height; ++i) new (node->next() + i) std::atomic<size_t>(0);
+     return node;
+   }
+
+   // for nodes that never held an element, or whose element is gone
+   static void free_memory(Node* node) { ::operator delete(node); }
+
+   static void dispose(void* node) {
+     static_cast<Node*>(node)->data()->~value_type();
+     free_memory(static_cast<Node*>(node));
+   }
+
+   // one in four nodes of a level reaches the next
+   static int random_height() {
+     static thread_local unsigned long long state = 0;
+     if (state == 0) state = reinterpret_cast<size_t>(&state) | 1;
+     state ^= state << 13;
+     state ^= state >> 7;
+     state ^= state << 17;
+     unsigned long long bits = state;
+     int height = 1;
+     while (height < max_height && (bits & 3) == 0) {
+       ++height;
+       bits >>= 2;
+     }
+     return height;
+   }
+
+   Compare comp;
+   Node* head;
+   std::atomic<size_t> size_;
+
+   /**
+  * fill preds and succs with the nodes around key at every level, unlinking
+  *   marked nodes on the way; returns whether succs[0] holds key.
+  * starts over whenever an unlink fails, since pred may be deleted itself.
+    */
+   bool search(const Key& key, Node** preds, Node** succs) const {
+     while (true) {
+       Node* pred = head;
+       bool restart = false;
+       for (int level = max_height - 1; level >= 0 && !restart; --level) {
+         Node* curr = ptr(pred->next()[level].load());
+         while (curr != nullptr) {
+           size_t succ = curr->next()[level].load();
+           if (marked(succ)) {
+             size_t expected = link_to(curr);
+             if (!pred->next()[level].compare_exchange_strong(expected, succ & ~size_t(1))) {
+               restart = true;
+               break;
+             }
+             curr = ptr(succ);
+             continue;
+           }
+           if (!comp(curr->data()->first, key)) break;
+           pred = curr;
+           curr = ptr(succ);
+         }
+         preds[level] = pred;
+         succs[level] = curr;
+       }
+       if (!restart) return succs[0] != nullptr && !comp(key, succs[0]->data()->first);
+     }
+   }
+
+   // the first node at the bottom level from node on that is not deleted
+   static Node* first_live(Node* node) {
+     while (node != nullptr && marked(node->next()[0].load())) node = ptr(node->next()[0].load());
+     return node;
+   }
+
+   /**
+  * the first live node whose key is not less than key, without unlinking
+  *   anything: readers go through deleted nodes, which stay allocated while
+  *   they are pinned.
+    */
+   Node* lower_bound_node(const Key& key) const {
+     Node* pred = head;
+     Node* curr = nullptr;
+     for (int level = max_height - 1; level >= 0; --level) {
+       curr = ptr(pred->next()[level].load());
+       while (curr != nullptr && comp(curr->data()->first, key)) {
+         pred = curr;
+         curr = ptr(curr->next()[level].load());
+       }
+     }
+     return first_live(curr);
+   }
+
+   /**
+  * drop one owner of node; the last one unlinks it and retires it.
+  * retiring it while its inserter may still link it at an upper level would
+  *   let that link make a retired node reachable again, for threads that pin
+  *   after the retire and so do not hold back its freeing. once both owners
+  *   let go, node is marked everywhere and nobody links it any more, so the
+  *   search that follows leaves it unreachable for good. data/concurrent
+  *   races the two on a handful of keys.
+    */
+   void release(Node* node) {
+     if (node->owners.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+     Node* preds[max_height];
+     Node* succs[max_height];
+     search(node->data()->first, preds, succs);
+     epoch_domain::instance().retire(node, &dispose);
+   }
+
+  public:
+   /**
+  * see BidirectionalIterator at CppReference for help; this one only
+  *   moves forwards.
+  * if there is anything wrong throw invalid_iterator.
+  *     like it = map.cend(); ++it;
+    */
+   class const_iterator {
+      private:
+       friend class concurrent_map;
+       epoch_guard guard;
+       const concurrent_map* owner;
+       Node* node;  // nullptr for end()
+
+       const_iterator(const concurrent_map* o, Node* n) : owner(o), node(n) {}
+
+      public:
+       const_iterator() : owner(nullptr), node(nullptr) {}
+
+       const_iterator(const const_iterator &other) : guard(other.guard), owner(other.owner), node(other.node) {}
+
+       const_iterator &operator=(const const_iterator &other) {
+         owner = other.owner;
+         node = other.node;
+         return *this;
+       }
+
+       const_iterator operator++(int) {
+         const_iterator tmp = *this;
+         ++*this;
+         return tmp;
+       }
+
+       const_iterator &operator++() {
+         if (node == nullptr) throw invalid_iterator();
+         node = first_live(ptr(node->next()[0].load()));
+         return *this;
+       }
+
+       const value_type &operator*() const {
+         if (node == nullptr) throw invalid_iterator();
+         return *node->data();
+       }
+
+       bool operator==(const const_iterator &rhs) const {
+         return node == rhs.node && (node != nullptr || owner == rhs.owner);
+       }
+
+       bool operator!=(const const_iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       const value_type *operator->() const noexcept {
+         return node != nullptr ? node->data() : nullptr;
+       }
+   };
+   typedef const_iterator iterator;
+
+   concurrent_map() : head(make_node(max_height)), size_(0) {}
+
+   concurrent_map(const concurrent_map &) = delete;
+   concurrent_map &operator=(const concurrent_map &) = delete;
+
+   /**
+  * nodes still linked are freed here; erased ones are already retired.
+    */
+   ~concurrent_map() {
+     Node* node = ptr(head->next()[0].load());
+     while (node != nullptr) {
+       Node* next = ptr(node->next()[0].load());
+       dispose(node);
+       node = next;
+     }
+     free_memory(head);
+   }
+
+   const_iterator begin() const {
+     epoch_guard guard;
+     return const_iterator(this, first_live(ptr(head->next()[0].load())));
+   }
+
+   const_iterator cbegin() const { return begin(); }
+
+   const_iterator end() const { return const_iterator(this, nullptr); }
+
+   const_iterator cend() const { return end(); }
+
+   /**
+  * the number of elements; only exact while no other thread is changing the map.
+    */
+   size_t size() const { return size_.load(); }
+
+   bool empty() const { return size() == 0; }
+
+   /**
+  * insert an element.
+  * return a pair, the first of the pair is
+  *   the iterator to the new element (or the element that prevented the insertion),
+  *   the second one is true if insert successfully, or false.
+  * the element exists once the bottom link is in; the upper links follow.
+    */
+   pair<const_iterator, bool> insert(const value_type &value) {
+     epoch_guard guard;
+     Node* preds[max_height];
+     Node* succs[max_height];
+     Node* node = nullptr;
+     int height = random_height();
+     while (true) {
+       if (search(value.first, preds, succs)) {
+         if (node != nullptr) dispose(node);
+         return pair<const_iterator, bool>(const_iterator(this, succs[0]), false);
+       }
+       if (node == nullptr) {
+         node = make_node(height);
+         new (node->storage) value_type(value);
+       }
+       for (int level = 0; level < height; ++level) node->next()[level].store(link_to(succs[level]));
+       size_t expected = link_to(succs[0]);
+       if (preds[0]->next()[0].compare_exchange_strong(expected, link_to(node))) break;
+     }
+     size_.fetch_add(1);
+     const_iterator result(this, node);
+     for (int level = 1; level < height; ++level) {
+       while (true) {
+         // a marked link means node is being erased: stop building it up
+         size_t link = node->next()[level].load();
+         if (marked(link)) {
+           release(node);
+           return pair<const_iterator, bool>(result, true);
+         }
+         if (ptr(link) != succs[level] && !node->next()[level].compare_exchange_strong(link, link_to(succs[level])))
+           continue;
+         size_t expected = link_to(succs[level]);
+         if (preds[level]->next()[level].compare_exchange_strong(expected, link_to(node))) break;
+         search(value.first, preds, succs);
+         if (succs[0] != node) {
+           release(node);
+           return pair<const_iterator, bool>(result, true);
+         }
+       }
+     }
+     release(node);
+     return pair<const_iterator, bool>(result, true);
+   }
+
+   /**
+  * erase the element with key, if there is one; returns how many were erased.
+    */
+   size_t erase(const Key &key) {
+     epoch_guard guard;
+     Node* preds[max_height];
+     Node* succs[max_height];
+     if (!search(key, preds, succs)) return 0;
+     Node* victim = succs[0];
+     for (int level = victim->height - 1; level > 0; --level) {
+       size_t link = victim->next()[level].load();
+       while (!marked(link) && !victim->next()[level].compare_exchange_weak(link, link | 1)) {}
+     }
+     size_t link = victim->next()[0].load();
+     while (true) {
+       if (marked(link)) return 0;  // another thread erased it first
+       if (victim->next()[0].compare_exchange_strong(link, link | 1)) break;
+     }
+     size_.fetch_sub(1);
+     release(victim);
+     return 1;
+   }
+
+   /**
+  * Returns the number of elements with key
+  *   that compares equivalent to the specified argument,
+  *   which is either 1 or 0
+  *     since this container does not allow duplicates.
+    */
+   size_t count(const Key &key) const {
+     epoch_guard guard;
+     Node* node = lower_bound_node(key);
+     return node != nullptr && !comp(key, node->data()->first) ? 1 : 0;
+   }
+
+   /**
+  * Finds an element with key equivalent to key.
+  *   If no such element is found, past-the-end (see end()) iterator is returned.
+    */
+   const_iterator find(const Key &key) const {
+     epoch_guard guard;
+     Node* node = lower_bound_node(key);
+     return const_iterator(this, node != nullptr && !comp(key, node->data()->first) ? node : nullptr);
+   }
+
+   /**
+  * the first element whose key is not less than key, or end().
+    */
+   const_iterator lower_bound(const Key &key) const {
+     epoch_guard guard;
+     return const_iterator(this, lower_bound_node(key));
+   }
+};
+
+}
+
+#endif
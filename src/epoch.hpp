@@ -0,0 +1,165 @@
+/**
+* epoch-based reclamation for the concurrent containers.
+* a thread pins the current epoch (an epoch_guard) around every access to
+*   shared nodes. a node that has been unlinked is retired instead of freed,
+*   tagged with the epoch at that time, and freed once the global epoch is two
+*   steps further: the epoch only advances while every pinned thread is in
+*   the current one, so by then no thread can still be looking at the node.
+*/
+#ifndef SJTU_EPOCH_HPP
+#define SJTU_EPOCH_HPP
+
+#include <atomic>
+#include <cstddef>
+
+namespace sjtu {
+
+/**
+* the process-wide reclamation domain shared by every container.
+* threads are registered on first use; a record left by a thread that exited
+*   is taken over by the next new thread, along with the nodes it still had
+*   waiting. whatever is left at exit is freed when the domain is destroyed.
+*/
+class epoch_domain {
+  private:
+   struct Retired {
+     void* object;
+     void (*dispose)(void*);
+     unsigned long epoch;
+     Retired* next;
+   };
+
+   struct Record {
+     std::atomic<unsigned long> state;  // 2 * epoch + 1 while pinned, 0 otherwise
+     std::atomic<bool> taken;
+     Record* next;
+     unsigned depth;                    // nested pins, only touched by the owner
+     Retired* limbo;
+     size_t retires;
+     Record() : state(0), taken(true), next(nullptr), depth(0), limbo(nullptr), retires(0) {}
+   };
+
+   // the calling thread's record, released when the thread exits
+   struct Holder {
+     Record* record;
+     Holder() : record(nullptr) {}
+     ~Holder() {
+       if (record != nullptr) record->taken.store(false);
+     }
+   };
+
+   // retired objects a thread collects after
+   static const size_t collect_every = 64;
+
+   std::atomic<unsigned long> epoch;
+   std::atomic<Record*> records;
+
+   epoch_domain() : epoch(1), records(nullptr) {}
+
+   Record* local() {
+     static thread_local Holder holder;
+     if (holder.record != nullptr) return holder.record;
+     for (Record* r = records.load(); r != nullptr; r = r->next) {
+       bool expected = false;
+       if (!r->taken.load() && r->taken.compare_exchange_strong(expected, true)) return holder.record = r;
+     }
+     Record* r = new Record();
+     r->next = records.load();
+     while (!records.compare_exchange_weak(r->next, r)) {}
+     return holder.record = r;
+   }
+
+   // move to the next epoch if every pinned thread has seen the current one
+   void try_advance() {
+     unsigned long current = epoch.load();
+     for (Record* r = records.load(); r != nullptr; r = r->next) {
+       unsigned long state = r->state.load();
+       if (state != 0 && state != 2 * current + 1) return;
+     }
+     epoch.compare_exchange_strong(current, current + 1);
+   }
+
+   void collect(Record* r) {
+     try_advance();
+     unsigned long current = epoch.load();
+     Retired** link = &r->limbo;
+     while (*link != nullptr) {
+       Retired* item = *link;
+       if (item->epoch + 2 <= current) {
+         *link = item->next;
+         item->dispose(item->object);
+         delete item;
+       } else {
+         link = &item->next;
+       }
+     }
+   }
+
+  public:
+   epoch_domain(const epoch_domain&) = delete;
+   epoch_domain& operator=(const epoch_domain&) = delete;
+
+   ~epoch_domain() {
+     Record* r = records.load();
+     while (r != nullptr) {
+       for (Retired* item = r->limbo; item != nullptr;) {
+         Retired* next = item->next;
+         item->dispose(item->object);
+         delete item;
+         item = next;
+       }
+       Record* next = r->next;
+       delete r;
+       r = next;
+     }
+   }
+
+   static epoch_domain& instance() {
+     static epoch_domain domain;
+     return domain;
+   }
+
+   void pin() {
+     Record* r = local();
+     if (r->depth++ == 0) {
+       r->state.store(2 * epoch.load() + 1);
+       std::atomic_thread_fence(std::memory_order_seq_cst);
+     }
+   }
+
+   void unpin() {
+     Record* r = local();
+     if (--r->depth == 0) r->state.store(0, std::memory_order_release);
+   }
+
+   /**
+  * free object with dispose(object) once no thread pinned now can reach it.
+  * object must already be unreachable for threads that pin from now on.
+    */
+   void retire(void* object, void (*dispose)(void*)) {
+     Record* r = local();
+     Retired* item = new Retired;
+     item->object = object;
+     item->dispose = dispose;
+     item->epoch = epoch.load();
+     item->next = r->limbo;
+     r->limbo = item;
+     if (++r->retires % collect_every == 0) collect(r);
+   }
+};
+
+/**
+* pins the calling thread for its lifetime; guards nest and copies pin again.
+* a guard belongs to the thread that made it.
+*/
+class epoch_guard {
+  public:
+   epoch_guard() { epoch_domain::instance().pin(); }
+   epoch_guard(const epoch_guard&) { epoch_domain::instance().pin(); }
+   epoch_guard& operator=(const epoch_guard&) { return *this; }
+   ~epoch_guard() { epoch_domain::instance().unpin(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,434 @@
+/**
+* a container like std::map over one sorted array.
+* meant for maps that are built once and then mostly read: there is no node
+*   per element, a lookup is a binary search over contiguous memory, and the
+*   iterators are random access. insert and erase shift the rest of the array,
+*   so they cost O(n).
+* an iterator is a position: insert and erase move the elements after the one
+*   they touch, and an iterator at or after that position then refers to
+*   whichever element has moved into its place (sjtu::map never moves elements).
+*   end() is the exception and stays end().
+*/
+#ifndef SJTU_FLAT_MAP_HPP
+#define SJTU_FLAT_MAP_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include "map.hpp"
+
+namespace sjtu {
+
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>
+   > class flat_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+   /**
+  * see RandomAccessIterator at CppReference for help.
+  *
+  * throws invalid_iterator like sjtu::map's iterators do, and also when
+  *   arithmetic would leave [begin(), end()].
+    */
+   class const_iterator;
+   class iterator {
+      private:
+       friend class flat_map;
+       friend class const_iterator;
+       flat_map* owner;
+       size_t index_;
+
+       size_t pos() const { return index_ == end_index && owner != nullptr ? owner->size_ : index_; }
+
+       iterator moved(ptrdiff_t n) const {
+         size_t i = pos();
+         if (owner == nullptr || (n < 0 && size_t(-n) > i) || (n > 0 && size_t(n) > owner->size_ - i))
+           throw invalid_iterator();
+         return iterator(owner, i + n == owner->size_ ? end_index : i + n);
+       }
+      public:
+       typedef std::random_access_iterator_tag iterator_category;
+       typedef flat_map::value_type value_type;
+       typedef ptrdiff_t difference_type;
+       typedef value_type* pointer;
+       typedef value_type& reference;
+
+       iterator() : owner(nullptr), index_(0) {}
+
+       iterator(flat_map* o, size_t i) : owner(o), index_(i) {}
+
+       iterator(const iterator &other) : owner(other.owner), index_(other.index_) {}
+
+       iterator &operator=(const iterator &other) {
+         owner = other.owner;
+         index_ = other.index_;
+         return *this;
+       }
+
+       iterator operator++(int) {
+         iterator tmp = *this;
+         *this = moved(1);
+         return tmp;
+       }
+
+       iterator &operator++() { return *this = moved(1); }
+
+       iterator operator--(int) {
+         iterator tmp = *this;
+         *this = moved(-1);
+         return tmp;
+       }
+
+       iterator &operator--() { return *this = moved(-1); }
+
+       iterator &operator+=(ptrdiff_t n) { return *this = moved(n); }
+
+       iterator &operator-=(ptrdiff_t n) { return *this = moved(-n); }
+
+       iterator operator+(ptrdiff_t n) const { return moved(n); }
+
+       iterator operator-(ptrdiff_t n) const { return moved(-n); }
+
+       ptrdiff_t operator-(const iterator &rhs) const {
+         if (owner != rhs.owner) throw invalid_iterator();
+         return ptrdiff_t(pos()) - ptrdiff_t(rhs.pos());
+       }
+
+       value_type &operator*() const {
+         if (owner == nullptr || pos() >= owner->size_) throw invalid_iterator();
+         return owner->items[index_];
+       }
+
+       value_type &operator[](ptrdiff_t n) const { return *moved(n); }
+
+       value_type *operator->() const noexcept {
+         return owner != nullptr && pos() < owner->size_ ? owner->items + index_ : nullptr;
+       }
+
+       bool operator==(const iterator &rhs) const { return owner == rhs.owner && pos() == rhs.pos(); }
+
+       bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && pos() == rhs.pos(); }
+
+       bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+
+       bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+       bool operator<(const iterator &rhs) const { return *this - rhs < 0; }
+
+       bool operator>(const iterator &rhs) const { return rhs < *this; }
+
+       bool operator<=(const iterator &rhs) const { return !(rhs < *this); }
+
+       bool operator>=(const iterator &rhs) const { return !(*this < rhs); }
+   };
+   class const_iterator {
+      private:
+       friend class flat_map;
+       friend class iterator;
+       const flat_map* owner;
+       size_t index_;
+
+       size_t pos() const { return index_ == end_index && owner != nullptr ? owner->size_ : index_; }
+
+       const_iterator moved(ptrdiff_t n) const {
+         size_t i = pos();
+         if (owner == nullptr || (n < 0 && size_t(-n) > i) || (n > 0 && size_t(n) > owner->size_ - i))
+           throw invalid_iterator();
+         return const_iterator(owner, i + n == owner->size_ ? end_index : i + n);
+       }
+      public:
+       typedef std::random_access_iterator_tag iterator_category;
+       typedef const flat_map::value_type value_type;
+       typedef ptrdiff_t difference_type;
+       typedef value_type* pointer;
+       typedef value_type& reference;
+
+       const_iterator() : owner(nullptr), index_(0) {}
+
+       const_iterator(const flat_map* o, size_t i) : owner(o), index_(i) {}
+
+       const_iterator(const const_iterator &other) : owner(other.owner), index_(other.index_) {}
+
+       const_iterator(const iterator &other) : owner(other.owner), index_(other.index_) {}
+
+       const_iterator &operator=(const const_iterator &other) {
+         owner = other.owner;
+         index_ = other.index_;
+         return *this;
+       }
+
+       const_iterator operator++(int) {
+         const_iterator tmp = *this;
+         *this = moved(1);
+         return tmp;
+       }
+
+       const_iterator &operator++() { return *this = moved(1); }
+
+       const_iterator operator--(int) {
+         const_iterator tmp = *this;
+         *this = moved(-1);
+         return tmp;
+       }
+
+       const_iterator &operator--() { return *this = moved(-1); }
+
+       const_iterator &operator+=(ptrdiff_t n) { return *this = moved(n); }
+
+       const_iterator &operator-=(ptrdiff_t n) { return *this = moved(-n); }
+
+       const_iterator operator+(ptrdiff_t n) const { return moved(n); }
+
+       const_iterator operator-(ptrdiff_t n) const { return moved(-n); }
+
+       ptrdiff_t operator-(const const_iterator &rhs) const {
+         if (owner != rhs.owner) throw invalid_iterator();
+         return ptrdiff_t(pos()) - ptrdiff_t(rhs.pos());
+       }
+
+       const value_type &operator*() const {
+         if (owner == nullptr || pos() >= owner->size_) throw invalid_iterator();
+         return owner->items[index_];
+       }
+
+       const value_type &operator[](ptrdiff_t n) const { return *moved(n); }
+
+       const value_type *operator->() const noexcept {
+         return owner != nullptr && pos() < owner->size_ ? owner->items + index_ : nullptr;
+       }
+
+       bool operator==(const iterator &rhs) const { return owner == rhs.owner && pos() == rhs.pos(); }
+
+       bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && pos() == rhs.pos(); }
+
+       bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+
+       bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+       bool operator<(const const_iterator &rhs) const { return *this - rhs < 0; }
+
+       bool operator>(const const_iterator &rhs) const { return rhs < *this; }
+
+       bool operator<=(const const_iterator &rhs) const { return !(rhs < *this); }
+
+       bool operator>=(const const_iterator &rhs) const { return !(*this < rhs); }
+   };
+
+  private:
+   /**
+  * an iterator stores this instead of size_ for end(), so an end iterator
+  *   stays end() while the map grows or shrinks, as sjtu::map's does.
+    */
+   static const size_t end_index = size_t(-1);
+
+   Compare comp;
+
+   /**
+  * items[0, size_) are constructed and sorted by key, the rest of the
+  *   capacity_ slots is raw memory.
+  * keys and values share one array because iterators hand out value_type&.
+    */
+   value_type* items;
+   size_t size_;
+   size_t capacity_;
+
+   static value_type* allocate(size_t n) {
+     return n == 0 ? nullptr : static_cast<value_type*>(::operator new(n * sizeof(value_type)));
+   }
+
+   // move-construct the element at from into the raw slot to
+   static void relocate(value_type* from, value_type* to) {
+     new (to) value_type(static_cast<value_type&&>(*from));
+     from->~value_type();
+   }
+
+   // index of the first element whose key is not less than key
+   size_t lower_index(const Key &key) const {
+     size_t lo = 0, n = size_;
+     while (n > 0) {
+       size_t half = n / 2;
+       if (comp(items[lo + half].first, key)) {
+         lo += half + 1;
+         n -= half + 1;
+       } else {
+         n = half;
+       }
+     }
+     return lo;
+   }
+
+   // index of the element with key, or size_
+   size_t find_index(const Key &key) const {
+     size_t i = lower_index(key);
+     return i < size_ && !comp(key, items[i].first) ? i : size_;
+   }
+
+   // the index an iterator stores for position i
+   size_t iterator_index(size_t i) const { return i == size_ ? end_index : i; }
+
+   void copy_from(const flat_map &other) {
+     reserve(other.size_);
+     for (size_t i = 0; i < other.size_; ++i) {
+       new (items + i) value_type(other.items[i]);
+       ++size_;
+     }
+   }
+
+  public:
+   flat_map() : items(nullptr), size_(0), capacity_(0) {}
+
+   flat_map(const flat_map &other) : items(nullptr), size_(0), capacity_(0) {
+     copy_from(other);
+   }
+
+   /**
+  * bulk build from a map in O(n): its elements are already in key order,
+  *   so they are copied straight into place without any search.
+    */
+   template<class Balance, size_t InlineNodes>
+   explicit flat_map(const map<Key, T, Compare, Balance, InlineNodes> &other) : items(nullptr), size_(0), capacity_(0) {
+     reserve(other.size());
+     other.for_each([this](const value_type &value) {
+       new (items + size_) value_type(value);
+       ++size_;
+     });
+   }
+
+   flat_map &operator=(const flat_map &other) {
+     if (this != &other) {
+       clear();
+       copy_from(other);
+     }
+     return *this;
+   }
+
+   ~flat_map() {
+     clear();
+     ::operator delete(items);
+   }
+
+   /**
+  * make room for n elements so that inserting up to n never reallocates.
+    */
+   void reserve(size_t n) {
+     if (n <= capacity_) return;
+     value_type* fresh = allocate(n);
+     for (size_t i = 0; i < size_; ++i) relocate(items + i, fresh + i);
+     ::operator delete(items);
+     items = fresh;
+     capacity_ = n;
+   }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a reference to the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T &at(const Key &key) {
+     size_t i = find_index(key);
+     if (i == size_) throw index_out_of_bound();
+     return items[i].second;
+   }
+
+   const T &at(const Key &key) const {
+     size_t i = find_index(key);
+     if (i == size_) throw index_out_of_bound();
+     return items[i].second;
+   }
+
+   /**
+  * access specified element
+  * Returns a reference to the value that is mapped to a key equivalent to key,
+  *   performing an insertion if such key does not already exist.
+    */
+   T &operator[](const Key &key) {
+     size_t i = find_index(key);
+     if (i != size_) return items[i].second;
+     value_type val(key, T());
+     return insert(val).first->second;
+   }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const {
+     return at(key);
+   }
+
+   iterator begin() { return iterator(this, iterator_index(0)); }
+
+   const_iterator cbegin() const { return const_iterator(this, iterator_index(0)); }
+
+   iterator end() { return iterator(this, end_index); }
+
+   const_iterator cend() const { return const_iterator(this, end_index); }
+
+   bool empty() const { return size_ == 0; }
+
+   size_t size() const { return size_; }
+
+   // keeps the capacity
+   void clear() {
+     for (size_t i = 0; i < size_; ++i) items[i].~value_type();
+     size_ = 0;
+   }
+
+   /**
+  * insert an element.
+  * return a pair, the first of the pair is
+  *   the iterator to the new element (or the element that prevented the insertion),
+  *   the second one is true if insert successfully, or false.
+    */
+   pair<iterator, bool> insert(const value_type &value) {
+     size_t i = lower_index(value.first);
+     if (i < size_ && !comp(value.first, items[i].first))
+       return pair<iterator, bool>(iterator(this, i), false);
+     if (size_ == capacity_) reserve(capacity_ == 0 ? 8 : 2 * capacity_);
+     for (size_t j = size_; j > i; --j) relocate(items + j - 1, items + j);
+     new (items + i) value_type(value);
+     ++size_;
+     return pair<iterator, bool>(iterator(this, i), true);
+   }
+
+   /**
+  * erase the element at pos.
+  *
+  * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+    */
+   void erase(iterator pos) {
+     if (pos.owner != this || pos.pos() >= size_) throw invalid_iterator();
+     items[pos.index_].~value_type();
+     for (size_t j = pos.index_ + 1; j < size_; ++j) relocate(items + j, items + j - 1);
+     --size_;
+   }
+
+   size_t count(const Key &key) const {
+     return find_index(key) != size_ ? 1 : 0;
+   }
+
+   iterator find(const Key &key) {
+     return iterator(this, iterator_index(find_index(key)));
+   }
+
+   const_iterator find(const Key &key) const {
+     return const_iterator(this, iterator_index(find_index(key)));
+   }
+
+   /**
+  * the first element whose key is not less than key, or end().
+    */
+   iterator lower_bound(const Key &key) {
+     return iterator(this, iterator_index(lower_index(key)));
+   }
+
+   const_iterator lower_bound(const Key &key) const {
+     return const_iterator(this, iterator_index(lower_index(key)));
+   }
+};
+
+}
+
+#endif
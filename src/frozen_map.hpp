@@ -0,0 +1,277 @@
+/**
+* an immutable snapshot of a map laid out for lookups, made by map::freeze().
+* the keys are stored in Eytzinger (breadth-first) order: the root of an
+*   implicit search tree first, then its two children, then the four nodes
+*   below, and so on. the top levels share a few cache lines, and all the
+*   descendants of a node some levels down are adjacent, so they can be
+*   prefetched long before the search reaches them.
+* elements are iterated in key order through a side permutation.
+*/
+#ifndef SJTU_FROZEN_MAP_HPP
+#define SJTU_FROZEN_MAP_HPP
+
+#include <cstddef>
+#include <functional>
+#include "map.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SJTU_FROZEN_CTZ(x) __builtin_ctzll(x)
+#else
+#define SJTU_FROZEN_CTZ(x) sjtu::frozen_ctz(x)
+#endif
+
+namespace sjtu {
+
+inline int frozen_ctz(unsigned long long x) {
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+}
+
+template<
+   class Key,
+   class T,
+   class Compare
+   > class frozen_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+   /**
+  * see BidirectionalIterator at CppReference for help.
+  * a frozen map cannot change, so every iterator is a const_iterator.
+  *
+  * if there is anything wrong throw invalid_iterator.
+  *     like it = map.cbegin(); --it;
+  *       or it = map.cend(); ++end();
+    */
+   class const_iterator {
+      private:
+       friend class frozen_map;
+       const frozen_map* owner;
+       size_t rank_;  // position in key order, size() for end()
+      public:
+       const_iterator() : owner(nullptr), rank_(0) {}
+
+       const_iterator(const frozen_map* o, size_t r) : owner(o), rank_(r) {}
+
+       const_iterator(const const_iterator &other) : owner(other.owner), rank_(other.rank_) {}
+
+       const_iterator operator++(int) {
+         const_iterator tmp = *this;
+         ++*this;
+         return tmp;
+       }
+
+       const_iterator &operator++() {
+         if (owner == nullptr || rank_ >= owner->size_) throw invalid_iterator();
+         ++rank_;
+         return *this;
+       }
+
+       const_iterator operator--(int) {
+         const_iterator tmp = *this;
+         --*this;
+         return tmp;
+       }
+
+       const_iterator &operator--() {
+         if (owner == nullptr || rank_ == 0) throw invalid_iterator();
+         --rank_;
+         return *this;
+       }
+
+       const value_type &operator*() const {
+         if (owner == nullptr || rank_ >= owner->size_) throw invalid_iterator();
+         return owner->items[owner->order[rank_]];
+       }
+
+       bool operator==(const const_iterator &rhs) const {
+         return owner == rhs.owner && rank_ == rhs.rank_;
+       }
+
+       bool operator!=(const const_iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       const value_type *operator->() const noexcept {
+         return owner != nullptr && rank_ < owner->size_ ? owner->items + owner->order[rank_] : nullptr;
+       }
+   };
+   typedef const_iterator iterator;
+
+  private:
+   Compare comp;
+   size_t size_;
+
+   /**
+  * slots 1..size_ of keys and items hold the implicit tree: slot i has
+  *   children 2i and 2i + 1. slot 0 is unused.
+  * keys is aligned to a cache line, so slots 16i..16i+15 of four-byte keys
+  *   (the descendants of slot i four levels down) share one line.
+  * order[k] is the slot of the k-th smallest key and rank[i] the inverse.
+    */
+   void* key_block;
+   Key* keys;
+   value_type* items;
+   size_t* order;
+   size_t* rank;
+
+   static const size_t line_bytes = 64;
+   // keys per cache line, rounded down to a power of two
+   static const size_t line_keys = sizeof(Key) >= 64 ? 1 : sizeof(Key) >= 32 ? 2
+                                   : sizeof(Key) >= 16 ? 4 : sizeof(Key) >= 8 ? 8 : 16;
+
+   void allocate(size_t n) {
+     key_block = ::operator new((n + 1) * sizeof(Key) + line_bytes);
+     size_t address = reinterpret_cast<size_t>(key_block);
+     keys = reinterpret_cast<Key*>((address + line_bytes - 1) / line_bytes * line_bytes);
+     items = static_cast<value_type*>(::operator new((n + 1) * sizeof(value_type)));
+     order = new size_t[n];
+     rank = new size_t[n + 1];
+   }
+
+   // slots in key order: the in-order walk of the implicit tree
+   void make_order() {
+     size_t k = 0;
+     size_t i = 1;
+     if (size_ == 0) return;
+     while (2 * i <= size_) i *= 2;
+     while (i != 0) {
+       order[k] = i;
+       rank[i] = k++;
+       if (2 * i + 1 <= size_) {
+         i = 2 * i + 1;
+         while (2 * i <= size_) i *= 2;
+       } else {
+         while (i & 1) i >>= 1;
+         i >>= 1;
+       }
+     }
+   }
+
+   void place(size_t k, const value_type &value) {
+     size_t i = order[k];
+     new (keys + i) Key(value.first);
+     new (items + i) value_type(value);
+   }
+
+   /**
+  * the slot of the first key not less than key, 0 if there is none.
+  * the descent has no data-dependent branch: each step goes to 2i or 2i + 1
+  *   by the comparison, and it ends after the same number of steps for every
+  *   key, give or take one. going right at every step after the last left
+  *   turn is what the trailing ones of i record, so shifting them out (and
+  *   one more bit) returns to the node where the search last went left,
+  *   which is the answer.
+    */
+   size_t lower_slot(const Key &key) const {
+     size_t i = 1;
+     while (i <= size_) {
+       SJTU_MAP_PREFETCH(keys + line_keys * i);
+       i = 2 * i + size_t(comp(keys[i], key));
+     }
+     return i >> (SJTU_FROZEN_CTZ(~(unsigned long long)i) + 1);
+   }
+
+   size_t find_slot(const Key &key) const {
+     size_t i = lower_slot(key);
+     return i != 0 && !comp(key, keys[i]) ? i : 0;
+   }
+
+   void destroy() {
+     for (size_t i = 1; i <= size_; ++i) {
+       keys[i].~Key();
+       items[i].~value_type();
+     }
+     ::operator delete(key_block);
+     ::operator delete(items);
+     delete[] order;
+     delete[] rank;
+   }
+
+  public:
+   /**
+  * snapshot of m in O(n): the slots are listed in key order first, then
+  *   m's elements, which come in key order too, are copied straight into them.
+    */
+   template<class Balance, size_t InlineNodes>
+   explicit frozen_map(const map<Key, T, Compare, Balance, InlineNodes> &m) : size_(m.size()) {
+     allocate(size_);
+     make_order();
+     size_t k = 0;
+     m.for_each([this, &k](const value_type &value) { place(k++, value); });
+   }
+
+   frozen_map(const frozen_map &other) : size_(other.size_) {
+     allocate(size_);
+     make_order();
+     for (size_t k = 0; k < size_; ++k) place(k, other.items[other.order[k]]);
+   }
+
+   frozen_map &operator=(const frozen_map &other) {
+     if (this != &other) {
+       destroy();
+       size_ = other.size_;
+       allocate(size_);
+       make_order();
+       for (size_t k = 0; k < size_; ++k) place(k, other.items[other.order[k]]);
+     }
+     return *this;
+   }
+
+   ~frozen_map() { destroy(); }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a reference to the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   const T &at(const Key &key) const {
+     size_t i = find_slot(key);
+     if (i == 0) throw index_out_of_bound();
+     return items[i].second;
+   }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const {
+     return at(key);
+   }
+
+   const_iterator begin() const { return const_iterator(this, 0); }
+
+   const_iterator cbegin() const { return const_iterator(this, 0); }
+
+   const_iterator end() const { return const_iterator(this, size_); }
+
+   const_iterator cend() const { return const_iterator(this, size_); }
+
+   bool empty() const { return size_ == 0; }
+
+   size_t size() const { return size_; }
+
+   size_t count(const Key &key) const {
+     return find_slot(key) != 0 ? 1 : 0;
+   }
+
+   const_iterator find(const Key &key) const {
+     size_t i = find_slot(key);
+     return const_iterator(this, i != 0 ? rank[i] : size_);
+   }
+
+   /**
+  * the first element whose key is not less than key, or end().
+    */
+   const_iterator lower_bound(const Key &key) const {
+     size_t i = lower_slot(key);
+     return const_iterator(this, i != 0 ? rank[i] : size_);
+   }
+};
+
+}
+
+#endif
@@ -7,15 +7,1080 @@
 // only for std::less<T>
 #include <functional>
 #include <cstddef>
+#include <cstring>
+#include <string>
 #include "utility.hpp"
 #include "exceptions.hpp"
 
+#if defined(__GNUC__) || defined(__clang__)
+#define SJTU_MAP_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define SJTU_MAP_PREFETCH(p) ((void)(p))
+#endif
+
 namespace sjtu {
 
+/**
+* store a tree link (a root, left or right pointer) that a reader of
+*   seqlock_map.hpp may be loading at the same time. the store is atomic and
+*   a release: a reader that loads the link with acquire also sees all the
+*   node it leads to, however recently that node was made. on x86 this is a
+*   plain store. the insert and erase paths and the rotations of every policy
+*   store links this way; copying, split and join never run beside such
+*   readers and store them plainly.
+*/
+template<class Node>
+inline void store_link(Node*& link, Node* value) {
+#if defined(__GNUC__) || defined(__clang__)
+  __atomic_store_n(&link, value, __ATOMIC_RELEASE);
+#else
+  link = value;
+#endif
+}
+
+// defined in map_parallel.hpp, which needs headers map.hpp itself may not use
+template<class Map> struct map_parallel;
+template<class Map> struct map_bulk_loader;
+
+// defined in frozen_map.hpp, include it to call map::freeze()
+template<class Key, class T, class Compare> class frozen_map;
+
+// defined in seqlock_map.hpp, which needs <atomic> and <mutex>
+template<class Key, class T, class Compare, class Balance> class seqlock_map;
+
+/**
+* balancing policies for the map's tree, selected by its Balance parameter.
+* every node carries one int, rank, whose meaning belongs to the policy.
+* the map links and unlinks nodes itself and then calls the policy:
+*   new_rank                 rank given to a freshly attached leaf
+*   after_insert(root, z)    z was just attached as a leaf
+*   after_erase(root, x, x_parent, removed_rank)
+*                            a node of rank removed_rank was unlinked and its only
+*                            child x (maybe nullptr) now hangs from x_parent there.
+*   after_access(root, node) a lookup on a non-const map ended at node
+*   bounded_depth            whether the depth is O(log n)
+*   joinable                 whether it provides split and join, see map::split(),
+*                            and size(node), the number of nodes in a subtree
+* a second word, aux, is free for policies that need more than rank.
+* when the erased node had two children its successor takes over its position
+*   and rank, and the successor's old position is the one reported.
+* policies only rotate, which keeps the in-order threads intact.
+*/
+struct tree_balance {
+   static const bool bounded_depth = true;
+   static const bool joinable = false;
+
+   template<class Node>
+   static void after_access(Node*&, Node*) {}
+
+   template<class Node>
+   static void rotate_left(Node*& root, Node* x) {
+     Node* y = x->right;
+     store_link(x->right, y->left);
+     if (y->left != nullptr) y->left->parent = x;
+     y->parent = x->parent;
+     if (x->parent == nullptr) store_link(root, y);
+     else if (x == x->parent->left) store_link(x->parent->left, y);
+     else store_link(x->parent->right, y);
+     store_link(y->left, x);
+     x->parent = y;
+   }
+
+   template<class Node>
+   static void rotate_right(Node*& root, Node* x) {
+     Node* y = x->left;
+     store_link(x->left, y->right);
+     if (y->right != nullptr) y->right->parent = x;
+     y->parent = x->parent;
+     if (x->parent == nullptr) store_link(root, y);
+     else if (x == x->parent->right) store_link(x->parent->right, y);
+     else store_link(x->parent->left, y);
+     store_link(y->right, x);
+     x->parent = y;
+   }
+};
+
+/**
+* red-black tree, rank is the color (0: black, 1: red).
+* at most two rotations per insert and three per erase, so it is the
+*   cheapest to update; lookups may go up to 2 log n deep.
+*/
+struct red_black_balance : tree_balance {
+   static const int new_rank = 1;
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* z) {
+     while (z->parent != nullptr && z->parent->rank == 1) {
+       if (z->parent->parent != nullptr && z->parent == z->parent->parent->left) {
+         Node* y = z->parent->parent->right;
+         if (y != nullptr && y->rank == 1) {
+           z->parent->rank = 0;
+           y->rank = 0;
+           z->parent->parent->rank = 1;
+           z = z->parent->parent;
+         } else {
+           if (z == z->parent->right) {
+             z = z->parent;
+             rotate_left(root, z);
+           }
+           z->parent->rank = 0;
+           if (z->parent->parent != nullptr) {
+             z->parent->parent->rank = 1;
+             rotate_right(root, z->parent->parent);
+           }
+         }
+       } else if (z->parent->parent != nullptr) {
+         Node* y = z->parent->parent->left;
+         if (y != nullptr && y->rank == 1) {
+           z->parent->rank = 0;
+           y->rank = 0;
+           z->parent->parent->rank = 1;
+           z = z->parent->parent;
+         } else {
+           if (z == z->parent->left) {
+             z = z->parent;
+             rotate_right(root, z);
+           }
+           z->parent->rank = 0;
+           if (z->parent->parent != nullptr) {
+             z->parent->parent->rank = 1;
+             rotate_left(root, z->parent->parent);
+           }
+         }
+       } else break;
+     }
+     root->rank = 0;
+   }
+
+   template<class Node>
+   static void after_erase(Node*& root, Node* x, Node* x_parent, int removed_rank) {
+     if (removed_rank == 1) return;
+     while (x != root && (x == nullptr || x->rank == 0)) {
+       if (x_parent != nullptr && x == x_parent->left) {
+         Node* w = x_parent->right;
+         if (w != nullptr && w->rank == 1) {
+           w->rank = 0;
+           x_parent->rank = 1;
+           rotate_left(root, x_parent);
+           w = x_parent->right;
+         }
+         if (w != nullptr && (w->left == nullptr || w->left->rank == 0) &&
+             (w->right == nullptr || w->right->rank == 0)) {
+           w->rank = 1;
+           x = x_parent;
+           x_parent = x->parent;
+         } else if (w != nullptr) {
+           if (w->right == nullptr || w->right->rank == 0) {
+             if (w->left != nullptr) w->left->rank = 0;
+             w->rank = 1;
+             rotate_right(root, w);
+             w = x_parent->right;
+           }
+           w->rank = x_parent->rank;
+           x_parent->rank = 0;
+           if (w->right != nullptr) w->right->rank = 0;
+           rotate_left(root, x_parent);
+           x = root;
+           x_parent = nullptr;
+         } else break;
+       } else if (x_parent != nullptr) {
+         Node* w = x_parent->left;
+         if (w != nullptr && w->rank == 1) {
+           w->rank = 0;
+           x_parent->rank = 1;
+           rotate_right(root, x_parent);
+           w = x_parent->left;
+         }
+         if (w != nullptr && (w->right == nullptr || w->right->rank == 0) &&
+             (w->left == nullptr || w->left->rank == 0)) {
+           w->rank = 1;
+           x = x_parent;
+           x_parent = x->parent;
+         } else if (w != nullptr) {
+           if (w->left == nullptr || w->left->rank == 0) {
+             if (w->right != nullptr) w->right->rank = 0;
+             w->rank = 1;
+             rotate_left(root, w);
+             w = x_parent->left;
+           }
+           w->rank = x_parent->rank;
+           x_parent->rank = 0;
+           if (w->left != nullptr) w->left->rank = 0;
+           rotate_right(root, x_parent);
+           x = root;
+           x_parent = nullptr;
+         } else break;
+       } else break;
+     }
+     if (x != nullptr) x->rank = 0;
+   }
+};
+
+/**
+* AVL tree, rank is the height of the subtree (nullptr counts as 0).
+* at most 1.44 log n deep, the shallowest of the policies, but an erase may
+*   rotate at every level on the way up.
+*/
+struct avl_balance : tree_balance {
+   static const int new_rank = 1;
+
+   template<class Node>
+   static int height(const Node* node) { return node != nullptr ? node->rank : 0; }
+
+   template<class Node>
+   static void update(Node* node) {
+     int l = height(node->left), r = height(node->right);
+     node->rank = (l > r ? l : r) + 1;
+   }
+
+   // fix a node whose children differ in height by at most 2, return the subtree's new root
+   template<class Node>
+   static Node* restore(Node*& root, Node* node) {
+     int diff = height(node->left) - height(node->right);
+     if (diff > 1) {
+       Node* l = node->left;
+       if (height(l->left) < height(l->right)) {
+         rotate_left(root, l);
+         update(l);
+       }
+       rotate_right(root, node);
+     } else if (diff < -1) {
+       Node* r = node->right;
+       if (height(r->right) < height(r->left)) {
+         rotate_right(root, r);
+         update(r);
+       }
+       rotate_left(root, node);
+     } else {
+       update(node);
+       return node;
+     }
+     update(node);
+     update(node->parent);
+     return node->parent;
+   }
+
+   // walk up from node until a subtree keeps the height it had before the update
+   template<class Node>
+   static void retrace(Node*& root, Node* node) {
+     while (node != nullptr) {
+       int old = node->rank;
+       node = restore(root, node);
+       if (node->rank == old) return;
+       node = node->parent;
+     }
+   }
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* z) { retrace(root, z->parent); }
+
+   template<class Node>
+   static void after_erase(Node*& root, Node*, Node* x_parent, int) { retrace(root, x_parent); }
+};
+
+/**
+* weak AVL tree (Haeupler, Sen and Tarjan), rank is a rank with nullptr at -1:
+*   every rank difference between parent and child is 1 or 2, leaves have rank 0.
+* built by inserts alone it is an AVL tree; like red-black it needs at most two
+*   rotations per insert and per erase, and stays within 2 log n levels.
+*/
+struct wavl_balance : tree_balance {
+   static const int new_rank = 0;
+
+   template<class Node>
+   static int rank_of(const Node* node) { return node != nullptr ? node->rank : -1; }
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* x) {
+     // x has the same rank as its parent
+     for (Node* p = x->parent; p != nullptr && p->rank == x->rank; x = p, p = p->parent) {
+       bool left = x == p->left;
+       Node* s = left ? p->right : p->left;
+       if (p->rank - rank_of(s) == 1) {
+         ++p->rank;
+         continue;
+       }
+       Node* inner = left ? x->right : x->left;
+       if (inner == nullptr || x->rank - inner->rank == 2) {
+         if (left) rotate_right(root, p);
+         else rotate_left(root, p);
+         --p->rank;
+       } else {
+         if (left) {
+           rotate_left(root, x);
+           rotate_right(root, p);
+         } else {
+           rotate_right(root, x);
+           rotate_left(root, p);
+         }
+         ++inner->rank;
+         --x->rank;
+         --p->rank;
+       }
+       return;
+     }
+   }
+
+   template<class Node>
+   static void after_erase(Node*& root, Node* x, Node* p, int) {
+     // a leaf whose both links are now nullptr must have rank 0
+     if (x == nullptr && p->left == nullptr && p->right == nullptr) {
+       p->rank = 0;
+       x = p;
+       p = p->parent;
+     }
+     // x is 3 below its parent
+     for (; p != nullptr && p->rank - rank_of(x) == 3; x = p, p = p->parent) {
+       bool left = x == p->left;
+       Node* s = left ? p->right : p->left;
+       if (p->rank - s->rank == 2) {
+         --p->rank;
+         continue;
+       }
+       Node* inner = left ? s->left : s->right;
+       Node* outer = left ? s->right : s->left;
+       if (s->rank - rank_of(inner) == 2 && s->rank - rank_of(outer) == 2) {
+         --p->rank;
+         --s->rank;
+         continue;
+       }
+       if (s->rank - rank_of(outer) == 1) {
+         if (left) rotate_left(root, p);
+         else rotate_right(root, p);
+         ++s->rank;
+         --p->rank;
+         if (p->left == nullptr && p->right == nullptr) --p->rank;
+       } else {
+         if (left) {
+           rotate_right(root, s);
+           rotate_left(root, p);
+         } else {
+           rotate_left(root, s);
+           rotate_right(root, p);
+         }
+         inner->rank += 2;
+         --s->rank;
+         p->rank -= 2;
+       }
+       return;
+     }
+   }
+};
+
+/**
+* AA tree, rank is the level (leaves are on level 1, nullptr on 0):
+*   a left child is one level down, a right child the same level at most once.
+* the simplest of the policies, but it rotates more than red-black does.
+*/
+struct aa_balance : tree_balance {
+   static const int new_rank = 1;
+
+   template<class Node>
+   static int level(const Node* node) { return node != nullptr ? node->rank : 0; }
+
+   template<class Node>
+   static Node* skew(Node*& root, Node* node) {
+     if (node->left == nullptr || node->left->rank != node->rank) return node;
+     rotate_right(root, node);
+     return node->parent;
+   }
+
+   template<class Node>
+   static Node* split(Node*& root, Node* node) {
+     if (node->right == nullptr || node->right->right == nullptr || node->right->right->rank != node->rank)
+       return node;
+     rotate_left(root, node);
+     ++node->parent->rank;
+     return node->parent;
+   }
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* z) {
+     for (Node* node = z->parent; node != nullptr; node = node->parent) {
+       node = skew(root, node);
+       node = split(root, node);
+     }
+   }
+
+   template<class Node>
+   static void after_erase(Node*& root, Node*, Node* x_parent, int) {
+     for (Node* node = x_parent; node != nullptr; node = node->parent) {
+       int l = level(node->left), r = level(node->right);
+       int should = (l < r ? l : r) + 1;
+       if (should < node->rank) {
+         node->rank = should;
+         if (node->right != nullptr && should < node->right->rank) node->right->rank = should;
+       }
+       node = skew(root, node);
+       if (node->right != nullptr) {
+         skew(root, node->right);
+         if (node->right->right != nullptr) skew(root, node->right->right);
+       }
+       node = split(root, node);
+       if (node->right != nullptr) split(root, node->right);
+     }
+   }
+};
+
+/**
+* splay tree (Sleator and Tarjan), rank is unused.
+* every insert and every lookup on a non-const map rotates the node it ended
+*   at up to the root, so hot keys stay a few levels deep and a skewed
+*   workload costs about the entropy of its key distribution per access.
+* depth is only bounded amortized: a single path can be O(n) long.
+*/
+struct splay_balance : tree_balance {
+   static const int new_rank = 0;
+   static const bool bounded_depth = false;
+
+   template<class Node>
+   static void splay(Node*& root, Node* x) {
+     while (x->parent != nullptr) {
+       Node* p = x->parent;
+       Node* g = p->parent;
+       bool left = x == p->left;
+       if (g == nullptr) {
+         if (left) rotate_right(root, p);
+         else rotate_left(root, p);
+       } else if (left == (p == g->left)) {
+         if (left) {
+           rotate_right(root, g);
+           rotate_right(root, p);
+         } else {
+           rotate_left(root, g);
+           rotate_left(root, p);
+         }
+       } else if (left) {
+         rotate_right(root, p);
+         rotate_left(root, g);
+       } else {
+         rotate_left(root, p);
+         rotate_right(root, g);
+       }
+     }
+   }
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* z) { splay(root, z); }
+
+   template<class Node>
+   static void after_erase(Node*& root, Node*, Node* x_parent, int) {
+     if (x_parent != nullptr) splay(root, x_parent);
+   }
+
+   template<class Node>
+   static void after_access(Node*& root, Node* node) { splay(root, node); }
+};
+
+/**
+* treap (Seidel and Aragon): aux is a priority kept in heap order, rank is the
+*   size of the subtree.
+* the priority is a hash of the node's address, so it needs no random state
+*   and a copied node keeps its own.
+* expected depth is about 1.39 log n, with no worst-case bound; in exchange
+*   two trees split and join in O(log n) expected, see map::split() and map::join().
+*/
+struct treap_balance : tree_balance {
+   static const int new_rank = 1;
+   static const bool bounded_depth = false;
+   static const bool joinable = true;
+
+   template<class Node>
+   static int size(const Node* node) { return node != nullptr ? node->rank : 0; }
+
+   template<class Node>
+   static void update(Node* node) { node->rank = size(node->left) + size(node->right) + 1; }
+
+   // recompute the sizes from node up to the root
+   template<class Node>
+   static void update_path(Node* node) {
+     for (; node != nullptr; node = node->parent) update(node);
+   }
+
+   template<class Node>
+   static unsigned priority_of(const Node* node) {
+     unsigned long long h = (unsigned long long)reinterpret_cast<size_t>(node);
+     h ^= h >> 30;
+     h *= 0xbf58476d1ce4e5b9ULL;
+     h ^= h >> 27;
+     h *= 0x94d049bb133111ebULL;
+     return unsigned(h >> 32);
+   }
+
+   // rotate node above its parent
+   template<class Node>
+   static void lift(Node*& root, Node* node) {
+     Node* p = node->parent;
+     if (node == p->left) rotate_right(root, p);
+     else rotate_left(root, p);
+     update(p);
+     update(node);
+   }
+
+   template<class Node>
+   static void after_insert(Node*& root, Node* z) {
+     z->aux = priority_of(z);
+     update_path(z->parent);
+     while (z->parent != nullptr && z->parent->aux < z->aux) lift(root, z);
+   }
+
+   /**
+  * sizes change on the whole path up from x_parent, and the only node that
+  *   can break heap order lies on it too: the successor that took over the
+  *   erased node's place, which is then rotated back down.
+    */
+   template<class Node>
+   static void after_erase(Node*& root, Node*, Node* x_parent, int) {
+     Node* moved = nullptr;
+     for (Node* node = x_parent; node != nullptr; node = node->parent) {
+       update(node);
+       if ((node->left != nullptr && node->left->aux > node->aux) ||
+           (node->right != nullptr && node->right->aux > node->aux))
+         moved = node;
+     }
+     while (moved != nullptr) {
+       Node* child = moved->left;
+       if (child == nullptr || (moved->right != nullptr && moved->right->aux > child->aux)) child = moved->right;
+       if (child == nullptr || child->aux <= moved->aux) break;
+       lift(root, child);
+     }
+   }
+
+   /**
+  * cut the tree at root into left, the nodes for which before(node) holds
+  *   (a prefix in key order), and right, the rest.
+  * walks down once, hanging every node it passes on the side it belongs to.
+    */
+   template<class Node, class Before>
+   static void split(Node* root, Before before, Node*& left, Node*& right) {
+     left = right = nullptr;
+     Node* left_tail = nullptr;   // rightmost node on the left side so far
+     Node* right_tail = nullptr;  // leftmost node on the right side so far
+     for (Node* node = root; node != nullptr;) {
+       Node* next;
+       if (before(node)) {
+         next = node->right;
+         if (left_tail == nullptr) left = node;
+         else left_tail->right = node;
+         node->parent = left_tail;
+         left_tail = node;
+       } else {
+         next = node->left;
+         if (right_tail == nullptr) right = node;
+         else right_tail->left = node;
+         node->parent = right_tail;
+         right_tail = node;
+       }
+       node = next;
+     }
+     if (left_tail != nullptr) left_tail->right = nullptr;
+     if (right_tail != nullptr) right_tail->left = nullptr;
+     update_path(left_tail);
+     update_path(right_tail);
+   }
+
+   /**
+  * the tree holding both left and right, every key in left being less than
+  *   every key in right: merge the right spine of left with the left spine
+  *   of right by priority.
+    */
+   // attach node (maybe nullptr) below parent, or make it the root
+   template<class Node>
+   static void hang(Node*& root, Node* parent, bool as_left, Node* node) {
+     if (parent == nullptr) root = node;
+     else if (as_left) parent->left = node;
+     else parent->right = node;
+     if (node != nullptr) node->parent = parent;
+   }
+
+   template<class Node>
+   static Node* join(Node* left, Node* right) {
+     Node* root = nullptr;
+     Node* parent = nullptr;
+     bool as_left = false;
+     while (left != nullptr && right != nullptr) {
+       Node* top;
+       bool next_left;
+       if (left->aux > right->aux) {
+         top = left;
+         left = left->right;
+         next_left = false;
+       } else {
+         top = right;
+         right = right->left;
+         next_left = true;
+       }
+       hang(root, parent, as_left, top);
+       parent = top;
+       as_left = next_left;
+     }
+     hang(root, parent, as_left, left != nullptr ? left : right);
+     update_path(parent);
+     return root;
+   }
+};
+
+/**
+* integer keys ordered by std::less are also indexed by an adaptive radix tree
+*   (Leis et al., ICDE 2013), which answers a point lookup by dispatching on one
+*   byte of the key per level instead of comparing keys at every tree level.
+* radix_key<Key, Compare>::value tells whether a map keeps one; for those keys
+*   bits(key) gives an unsigned number of the same order, bytes bytes wide.
+*/
+template<class Int, bool Signed>
+struct radix_integer {
+  static const bool value = true;
+  static const int bytes = sizeof(Int);
+  static unsigned long long bits(Int key) {
+    unsigned long long u = (unsigned long long)key & (~0ULL >> (64 - 8 * sizeof(Int)));
+    return Signed ? u ^ (1ULL << (8 * sizeof(Int) - 1)) : u;
+  }
+};
+
+template<class Key, class Compare>
+struct radix_key {
+  static const bool value = false;
+};
+
+template<> struct radix_key<bool, std::less<bool> > : radix_integer<bool, false> {};
+template<> struct radix_key<char, std::less<char> > : radix_integer<char, (char(-1) < 0)> {};
+template<> struct radix_key<signed char, std::less<signed char> > : radix_integer<signed char, true> {};
+template<> struct radix_key<unsigned char, std::less<unsigned char> > : radix_integer<unsigned char, false> {};
+template<> struct radix_key<wchar_t, std::less<wchar_t> > : radix_integer<wchar_t, (wchar_t(-1) < 0)> {};
+template<> struct radix_key<char16_t, std::less<char16_t> > : radix_integer<char16_t, false> {};
+template<> struct radix_key<char32_t, std::less<char32_t> > : radix_integer<char32_t, false> {};
+template<> struct radix_key<short, std::less<short> > : radix_integer<short, true> {};
+template<> struct radix_key<unsigned short, std::less<unsigned short> > : radix_integer<unsigned short, false> {};
+template<> struct radix_key<int, std::less<int> > : radix_integer<int, true> {};
+template<> struct radix_key<unsigned int, std::less<unsigned int> > : radix_integer<unsigned int, false> {};
+template<> struct radix_key<long, std::less<long> > : radix_integer<long, true> {};
+template<> struct radix_key<unsigned long, std::less<unsigned long> > : radix_integer<unsigned long, false> {};
+template<> struct radix_key<long long, std::less<long long> > : radix_integer<long long, true> {};
+template<> struct radix_key<unsigned long long, std::less<unsigned long long> > : radix_integer<unsigned long long, false> {};
+
+/**
+* the radix tree from a key to the map node (Leaf) holding it.
+* the primary template is the stand-in for keys without radix_key:
+*   it holds nothing and every call on it compiles away.
+*/
+template<class Key, class Compare, class Leaf, bool Enabled = radix_key<Key, Compare>::value>
+class radix_index {
+  public:
+   static const bool enabled = false;
+   Leaf* find(const Key&) const { return nullptr; }
+   void insert(Leaf*) {}
+   void erase(Leaf*) {}
+   void replace(Leaf*) {}
+   void clear() {}
+   void swap(radix_index&) {}
+};
+
+template<class Key, class Compare, class Leaf>
+class radix_index<Key, Compare, Leaf, true> {
+  public:
+   static const bool enabled = true;
+
+  private:
+   typedef radix_key<Key, Compare> traits;
+   static const int bytes = traits::bytes;
+
+   /**
+  * inner nodes come in four sizes and grow or shrink between them as
+  *   children come and go: Node4 and Node16 keep key bytes and children in
+  *   unsorted parallel arrays, Node48 maps a byte to one of 48 child slots
+  *   (slot numbers are stored plus one, 0 is empty), Node256 is indexed by it.
+  * a child is an inner node or, tagged with its lowest bit, a Leaf.
+  * an inner node branches on byte depth of the key. all keys below it share
+  *   the bytes above depth, those of prefix, so levels without a branch are
+  *   skipped (path compression), and a leaf hangs right below the last
+  *   branch on its path (lazy expansion): a lookup checks the whole key once
+  *   at the end instead of the skipped bytes on the way down.
+  * the depth is at most bytes levels, so the code here may recurse.
+    */
+   struct Inner {
+     unsigned short kind;  // 4, 16, 48 or 256
+     unsigned short count;
+     int depth;
+     unsigned long long prefix;
+   };
+
+   template<int N>
+   struct NodeN : Inner {
+     unsigned char key[N];
+     Inner* child[N];
+   };
+   typedef NodeN<4> Node4;
+   typedef NodeN<16> Node16;
+
+   struct Node48 : Inner {
+     unsigned char slot[256];
+     Inner* child[48];
+   };
+
+   struct Node256 : Inner {
+     Inner* child[256];
+   };
+
+   Inner* root;
+
+   static bool is_leaf(const Inner* child) { return (reinterpret_cast<size_t>(child) & 1) != 0; }
+   static Leaf* as_leaf(Inner* child) { return reinterpret_cast<Leaf*>(reinterpret_cast<size_t>(child) - 1); }
+   static Inner* tag(Leaf* leaf) { return reinterpret_cast<Inner*>(reinterpret_cast<size_t>(leaf) + 1); }
+
+   static unsigned long long bits_of(const Leaf* leaf) { return traits::bits(leaf->data()->first); }
+
+   static unsigned byte_at(unsigned long long bits, int depth) {
+     return unsigned(bits >> (8 * (bytes - 1 - depth))) & 0xff;
+   }
+
+   // the bits of the bytes above depth
+   static unsigned long long above(int depth) { return depth == 0 ? 0 : ~0ULL << (8 * (bytes - depth)); }
+
+   template<class Node>
+   static Node* make(int kind, const Inner* like) {
+     Node* node = new Node();
+     node->kind = kind;
+     node->count = like->count;
+     node->depth = like->depth;
+     node->prefix = like->prefix;
+     return node;
+   }
+
+   static void free_node(Inner* node) {
+     switch (node->kind) {
+       case 4: delete static_cast<Node4*>(node); break;
+       case 16: delete static_cast<Node16*>(node); break;
+       case 48: delete static_cast<Node48*>(node); break;
+       default: delete static_cast<Node256*>(node); break;
+     }
+   }
+
+   static void destroy(Inner* node) {
+     if (node == nullptr || is_leaf(node)) return;
+     switch (node->kind) {
+       case 4:
+         for (int i = 0; i < node->count; ++i) destroy(static_cast<Node4*>(node)->child[i]);
+         break;
+       case 16:
+         for (int i = 0; i < node->count; ++i) destroy(static_cast<Node16*>(node)->child[i]);
+         break;
+       case 48:
+         for (int i = 0; i < 48; ++i) destroy(static_cast<Node48*>(node)->child[i]);
+         break;
+       default:
+         for (int i = 0; i < 256; ++i) destroy(static_cast<Node256*>(node)->child[i]);
+         break;
+     }
+     free_node(node);
+   }
+
+   template<int N>
+   static Inner** small_child(NodeN<N>* node, unsigned byte) {
+     for (int i = 0; i < node->count; ++i)
+       if (node->key[i] == byte) return &node->child[i];
+     return nullptr;
+   }
+
+   // the link to the child for byte, nullptr if there is none
+   static Inner** child_ref(Inner* node, unsigned byte) {
+     switch (node->kind) {
+       case 4: return small_child(static_cast<Node4*>(node), byte);
+       case 16: return small_child(static_cast<Node16*>(node), byte);
+       case 48: {
+         Node48* n = static_cast<Node48*>(node);
+         return n->slot[byte] != 0 ? &n->child[n->slot[byte] - 1] : nullptr;
+       }
+       default: {
+         Node256* n = static_cast<Node256*>(node);
+         return n->child[byte] != nullptr ? &n->child[byte] : nullptr;
+       }
+     }
+   }
+
+   static Inner* grow(Inner* node) {
+     Inner* bigger;
+     if (node->kind == 4) {
+       Node4* n = static_cast<Node4*>(node);
+       Node16* m = make<Node16>(16, n);
+       for (int i = 0; i < n->count; ++i) {
+         m->key[i] = n->key[i];
+         m->child[i] = n->child[i];
+       }
+       bigger = m;
+     } else if (node->kind == 16) {
+       Node16* n = static_cast<Node16*>(node);
+       Node48* m = make<Node48>(48, n);
+       for (int i = 0; i < n->count; ++i) {
+         m->slot[n->key[i]] = i + 1;
+         m->child[i] = n->child[i];
+       }
+       bigger = m;
+     } else {
+       Node48* n = static_cast<Node48*>(node);
+       Node256* m = make<Node256>(256, n);
+       for (int b = 0; b < 256; ++b)
+         if (n->slot[b] != 0) m->child[b] = n->child[n->slot[b] - 1];
+       bigger = m;
+     }
+     free_node(node);
+     return bigger;
+   }
+
+   static void add_child(Inner** ref, unsigned byte, Inner* child) {
+     Inner* node = *ref;
+     if (node->count == (node->kind == 48 ? 48 : node->kind)) *ref = node = grow(node);
+     switch (node->kind) {
+       case 4: {
+         Node4* n = static_cast<Node4*>(node);
+         n->key[n->count] = byte;
+         n->child[n->count] = child;
+         break;
+       }
+       case 16: {
+         Node16* n = static_cast<Node16*>(node);
+         n->key[n->count] = byte;
+         n->child[n->count] = child;
+         break;
+       }
+       case 48: {
+         Node48* n = static_cast<Node48*>(node);
+         int i = 0;
+         while (n->child[i] != nullptr) ++i;
+         n->child[i] = child;
+         n->slot[byte] = i + 1;
+         break;
+       }
+       default:
+         static_cast<Node256*>(node)->child[byte] = child;
+         break;
+     }
+     ++node->count;
+   }
+
+   template<int N>
+   static void remove_small(NodeN<N>* node, unsigned byte) {
+     int i = 0;
+     while (node->key[i] != byte) ++i;
+     --node->count;
+     node->key[i] = node->key[node->count];
+     node->child[i] = node->child[node->count];
+   }
+
+   /**
+  * drop the child for byte from *ref, then move the node down a size once it
+  *   is well below the smaller capacity, or replace it by its last child.
+    */
+   static void remove_child(Inner** ref, unsigned byte) {
+     Inner* node = *ref;
+     Inner* smaller = nullptr;
+     switch (node->kind) {
+       case 4: {
+         Node4* n = static_cast<Node4*>(node);
+         remove_small(n, byte);
+         if (n->count == 1) smaller = n->child[0];
+         break;
+       }
+       case 16: {
+         Node16* n = static_cast<Node16*>(node);
+         remove_small(n, byte);
+         if (n->count == 3) {
+           Node4* m = make<Node4>(4, n);
+           for (int i = 0; i < 3; ++i) {
+             m->key[i] = n->key[i];
+             m->child[i] = n->child[i];
+           }
+           smaller = m;
+         }
+         break;
+       }
+       case 48: {
+         Node48* n = static_cast<Node48*>(node);
+         n->child[n->slot[byte] - 1] = nullptr;
+         n->slot[byte] = 0;
+         if (--n->count == 12) {
+           Node16* m = make<Node16>(16, n);
+           int k = 0;
+           for (int b = 0; b < 256; ++b)
+             if (n->slot[b] != 0) {
+               m->key[k] = b;
+               m->child[k++] = n->child[n->slot[b] - 1];
+             }
+           smaller = m;
+         }
+         break;
+       }
+       default: {
+         Node256* n = static_cast<Node256*>(node);
+         n->child[byte] = nullptr;
+         if (--n->count == 37) {
+           Node48* m = make<Node48>(48, n);
+           int k = 0;
+           for (int b = 0; b < 256; ++b)
+             if (n->child[b] != nullptr) {
+               m->child[k] = n->child[b];
+               m->slot[b] = ++k;
+             }
+           smaller = m;
+         }
+         break;
+       }
+     }
+     if (smaller != nullptr) {
+       free_node(node);
+       *ref = smaller;
+     }
+   }
+
+   /**
+  * hang leaf next to *ref, whose keys all begin like other:
+  *   a new Node4 branches at the first byte where bits and other differ.
+    */
+   static void branch(Inner** ref, unsigned long long other, unsigned long long bits, Leaf* leaf) {
+     int depth = 0;
+     while (byte_at(bits, depth) == byte_at(other, depth)) ++depth;
+     Node4* n = new Node4();
+     n->kind = 4;
+     n->count = 2;
+     n->depth = depth;
+     n->prefix = bits;
+     n->key[0] = byte_at(other, depth);
+     n->child[0] = *ref;
+     n->key[1] = byte_at(bits, depth);
+     n->child[1] = tag(leaf);
+     *ref = n;
+   }
+
+  public:
+   radix_index() : root(nullptr) {}
+
+   radix_index(const radix_index&) = delete;
+   radix_index& operator=(const radix_index&) = delete;
+
+   ~radix_index() { destroy(root); }
+
+   Leaf* find(const Key& key) const {
+     unsigned long long bits = traits::bits(key);
+     Inner* node = root;
+     while (node != nullptr && !is_leaf(node)) {
+       Inner** next = child_ref(node, byte_at(bits, node->depth));
+       node = next != nullptr ? *next : nullptr;
+     }
+     if (node == nullptr) return nullptr;
+     Leaf* leaf = as_leaf(node);
+     return bits_of(leaf) == bits ? leaf : nullptr;
+   }
+
+   // leaf's key must not be in the tree yet
+   void insert(Leaf* leaf) {
+     unsigned long long bits = bits_of(leaf);
+     Inner** ref = &root;
+     while (true) {
+       Inner* node = *ref;
+       if (node == nullptr) {
+         *ref = tag(leaf);
+         return;
+       }
+       if (is_leaf(node)) {
+         branch(ref, bits_of(as_leaf(node)), bits, leaf);
+         return;
+       }
+       if (((bits ^ node->prefix) & above(node->depth)) != 0) {
+         branch(ref, node->prefix, bits, leaf);
+         return;
+       }
+       unsigned byte = byte_at(bits, node->depth);
+       Inner** next = child_ref(node, byte);
+       if (next == nullptr) {
+         add_child(ref, byte, tag(leaf));
+         return;
+       }
+       ref = next;
+     }
+   }
+
+   // leaf must be in the tree
+   void erase(Leaf* leaf) {
+     unsigned long long bits = bits_of(leaf);
+     Inner** ref = &root;
+     Inner** parent = nullptr;
+     while (!is_leaf(*ref)) {
+       parent = ref;
+       ref = child_ref(*ref, byte_at(bits, (*ref)->depth));
+     }
+     if (parent == nullptr) root = nullptr;
+     else remove_child(parent, byte_at(bits, (*parent)->depth));
+   }
+
+   // point the entry for leaf's key, which must be in the tree, at leaf
+   void replace(Leaf* leaf) {
+     unsigned long long bits = bits_of(leaf);
+     Inner** ref = &root;
+     while (!is_leaf(*ref)) ref = child_ref(*ref, byte_at(bits, (*ref)->depth));
+     *ref = tag(leaf);
+   }
+
+   void clear() {
+     destroy(root);
+     root = nullptr;
+   }
+
+   // trade trees with other in O(1), for split and join
+   void swap(radix_index& other) {
+     Inner* mine = root;
+     root = other.root;
+     other.root = mine;
+   }
+};
+
+/**
+* std::string keys ordered by std::less also keep their first eight bytes in
+*   every node, packed big-endian and zero padded into one integer. wherever
+*   two such integers differ they order the strings the same way, so a search
+*   packs its key once into a probe and settles most nodes on the way down
+*   with one integer comparison, without reaching into the string's buffer;
+*   only keys that share their first eight bytes are compared in full.
+* the primary template is the stand-in for other keys: its slot is an empty
+*   base of the node and order() never decides.
+*/
+template<class Key, class Compare>
+struct key_prefix {
+  struct slot {};
+  struct probe {
+    const Key& key;
+    explicit probe(const Key& k) : key(k) {}
+  };
+  static void store(slot&, const Key&) {}
+  // < 0 or > 0 when the prefixes put probe's key before or after slot's, 0 when they tie
+  static int order(const probe&, const slot&) { return 0; }
+};
+
+template<>
+struct key_prefix<std::string, std::less<std::string> > {
+  static unsigned long long pack(const std::string& key) {
+    unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    memcpy(bytes, key.data(), key.size() < 8 ? key.size() : 8);
+    unsigned long long packed = 0;
+    for (int i = 0; i < 8; ++i) packed = packed << 8 | bytes[i];
+    return packed;
+  }
+  struct slot {
+    unsigned long long prefix;
+  };
+  struct probe {
+    const std::string& key;
+    unsigned long long prefix;
+    explicit probe(const std::string& k) : key(k), prefix(pack(k)) {}
+  };
+  static void store(slot& s, const std::string& key) { s.prefix = pack(key); }
+  static int order(const probe& p, const slot& s) { return int(p.prefix > s.prefix) - int(p.prefix < s.prefix); }
+};
+
 template<
    class Key,
    class T,
-   class Compare = std::less <Key>
+   class Compare = std::less <Key>,
+   class Balance = red_black_balance,
+   size_t InlineNodes = 0
    > class map {
   public:
    /**
@@ -26,8 +1091,43 @@ template<
    typedef pair<const Key, T> value_type;
 
   private:
+   struct NodeBase;
    struct Node;
 
+   template<class Map> friend struct map_parallel;
+   template<class Map> friend struct map_bulk_loader;
+   template<class K, class V, class C, class B> friend class seqlock_map;
+
+   /**
+  * what an iterator knows about its map.
+  * by default it keeps the owner and validates every step, dereference and erase.
+  * compiling with SJTU_MAP_UNCHECKED_ITERATORS selects the empty specialization:
+  *   iterators shrink to a single node pointer and the checks compile away,
+  *   so misuse is undefined behaviour instead of invalid_iterator.
+    */
+#ifdef SJTU_MAP_UNCHECKED_ITERATORS
+   static const bool checked_iterators = false;
+#else
+   static const bool checked_iterators = true;
+#endif
+
+   template<class Owner, bool Checked = checked_iterators>
+   struct iterator_guard {
+     Owner* owner;
+     explicit iterator_guard(Owner* o) : owner(o) {}
+     Owner* get() const { return owner; }
+     bool can_deref(const NodeBase* node) const { return owner != nullptr && node != &owner->header; }
+     bool can_retreat(const NodeBase* node) const { return owner != nullptr && node->prev != &owner->header; }
+   };
+
+   template<class Owner>
+   struct iterator_guard<Owner, false> {
+     explicit iterator_guard(Owner*) {}
+     Owner* get() const { return nullptr; }
+     bool can_deref(const NodeBase*) const { return true; }
+     bool can_retreat(const NodeBase*) const { return true; }
+   };
+
   public:
    /**
   * see BidirectionalIterator at CppReference for help.
@@ -35,70 +1135,60 @@ template<
   * if there is anything wrong throw invalid_iterator.
   *     like it = map.begin(); --it;
   *       or it = map.end(); ++end();
+  * end() points at the map's header node, so stepping is the same
+  *   pointer load everywhere and only the header needs checking.
     */
    class const_iterator;
-   class iterator {
+   class iterator : private iterator_guard<map> {
       private:
        friend class map;
        friend class const_iterator;
-       Node* node_;
-       map* owner;
+       typedef iterator_guard<map> guard;
+       NodeBase* node_;
       public:
-       iterator() : node_(nullptr), owner(nullptr) {}
+       iterator() : guard(nullptr), node_(nullptr) {}
 
-       iterator(Node* n, map* o) : node_(n), owner(o) {}
+       iterator(NodeBase* n, map* o) : guard(o), node_(n) {}
 
-       iterator(const iterator &other) : node_(other.node_), owner(other.owner) {}
+       iterator(const iterator &other) : guard(other), node_(other.node_) {}
 
        iterator operator++(int) {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
+         if (!guard::can_deref(node_)) throw invalid_iterator();
          iterator tmp = *this;
-         node_ = owner->successor_node(node_);
+         node_ = node_->next;
          return tmp;
        }
 
        iterator &operator++() {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
-         node_ = owner->successor_node(node_);
+         if (!guard::can_deref(node_)) throw invalid_iterator();
+         node_ = node_->next;
          return *this;
        }
 
        iterator operator--(int) {
+         if (!guard::can_retreat(node_)) throw invalid_iterator();
          iterator tmp = *this;
-         if (owner == nullptr) throw invalid_iterator();
-         if (node_ == nullptr) {
-           node_ = owner->maximum(owner->root);
-           if (node_ == nullptr) throw invalid_iterator();
-         } else {
-           node_ = owner->predecessor_node(node_);
-           if (node_ == nullptr) throw invalid_iterator();
-         }
+         node_ = node_->prev;
          return tmp;
        }
 
        iterator &operator--() {
-         if (owner == nullptr) throw invalid_iterator();
-         if (node_ == nullptr) {
-           node_ = owner->maximum(owner->root);
-           if (node_ == nullptr) throw invalid_iterator();
-         } else {
-           node_ = owner->predecessor_node(node_);
-           if (node_ == nullptr) throw invalid_iterator();
-         }
+         if (!guard::can_retreat(node_)) throw invalid_iterator();
+         node_ = node_->prev;
          return *this;
        }
 
        value_type &operator*() const {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
-         return *node_->data();
+         if (!guard::can_deref(node_)) throw invalid_iterator();
+         return *static_cast<Node*>(node_)->data();
        }
 
        bool operator==(const iterator &rhs) const {
-         return owner == rhs.owner && node_ == rhs.node_;
+         return guard::get() == rhs.get() && node_ == rhs.node_;
        }
 
        bool operator==(const const_iterator &rhs) const {
-         return owner == rhs.owner && node_ == rhs.node_;
+         return guard::get() == rhs.get() && node_ == rhs.node_;
        }
 
        bool operator!=(const iterator &rhs) const {
@@ -110,73 +1200,61 @@ template<
        }
 
        value_type *operator->() const noexcept {
-         return node_ != nullptr ? node_->data() : nullptr;
+         return guard::can_deref(node_) ? static_cast<Node*>(node_)->data() : nullptr;
        }
    };
-   class const_iterator {
+   class const_iterator : private iterator_guard<const map> {
       private:
        friend class map;
        friend class iterator;
-       const Node* node_;
-       const map* owner;
+       typedef iterator_guard<const map> guard;
+       const NodeBase* node_;
       public:
-       const_iterator() : node_(nullptr), owner(nullptr) {}
+       const_iterator() : guard(nullptr), node_(nullptr) {}
 
-       const_iterator(const Node* n, const map* o) : node_(n), owner(o) {}
+       const_iterator(const NodeBase* n, const map* o) : guard(o), node_(n) {}
 
-       const_iterator(const const_iterator &other) : node_(other.node_), owner(other.owner) {}
+       const_iterator(const const_iterator &other) : guard(other), node_(other.node_) {}
 
-       const_iterator(const iterator &other) : node_(other.node_), owner(other.owner) {}
+       const_iterator(const iterator &other) : guard(other.get()), node_(other.node_) {}
 
        const_iterator operator++(int) {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
+         if (!guard::can_deref(node_)) throw invalid_iterator();
          const_iterator tmp = *this;
-         node_ = owner->successor_node(node_);
+         node_ = node_->next;
          return tmp;
        }
 
        const_iterator &operator++() {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
-         node_ = owner->successor_node(node_);
+         if (!guard::can_deref(node_)) throw invalid_iterator();
+         node_ = node_->next;
          return *this;
        }
 
        const_iterator operator--(int) {
+         if (!guard::can_retreat(node_)) throw invalid_iterator();
          const_iterator tmp = *this;
-         if (owner == nullptr) throw invalid_iterator();
-         if (node_ == nullptr) {
-           node_ = owner->maximum(owner->root);
-           if (node_ == nullptr) throw invalid_iterator();
-         } else {
-           node_ = owner->predecessor_node(node_);
-           if (node_ == nullptr) throw invalid_iterator();
-         }
+         node_ = node_->prev;
          return tmp;
        }
 
        const_iterator &operator--() {
-         if (owner == nullptr) throw invalid_iterator();
-         if (node_ == nullptr) {
-           node_ = owner->maximum(owner->root);
-           if (node_ == nullptr) throw invalid_iterator();
-         } else {
-           node_ = owner->predecessor_node(node_);
-           if (node_ == nullptr) throw invalid_iterator();
-         }
+         if (!guard::can_retreat(node_)) throw invalid_iterator();
+         node_ = node_->prev;
          return *this;
        }
 
        const value_type &operator*() const {
-         if (owner == nullptr || node_ == nullptr) throw invalid_iterator();
-         return *node_->data();
+         if (!guard::can_deref(node_)) throw invalid_iterator();
+         return *static_cast<const Node*>(node_)->data();
        }
 
        bool operator==(const iterator &rhs) const {
-         return owner == rhs.owner && node_ == rhs.node_;
+         return guard::get() == rhs.get() && node_ == rhs.node_;
        }
 
        bool operator==(const const_iterator &rhs) const {
-         return owner == rhs.owner && node_ == rhs.node_;
+         return guard::get() == rhs.get() && node_ == rhs.node_;
        }
 
        bool operator!=(const iterator &rhs) const {
@@ -188,60 +1266,674 @@ template<
        }
 
        const value_type *operator->() const noexcept {
-         return node_ != nullptr ? node_->data() : nullptr;
+         return guard::can_deref(node_) ? static_cast<const Node*>(node_)->data() : nullptr;
+       }
+   };
+
+   /**
+  * walks an iterator range backwards: ++ moves the underlying iterator back.
+  * like std::reverse_iterator it refers to the element just before base().
+    */
+   template<class Iter>
+   class reverse_adaptor {
+      private:
+       Iter base_;
+      public:
+       explicit reverse_adaptor(Iter it) : base_(it) {}
+
+       Iter base() const { return base_; }
+
+       auto operator*() const -> decltype(*base_) {
+         Iter tmp = base_;
+         return *--tmp;
+       }
+
+       auto operator->() const -> decltype(base_.operator->()) {
+         Iter tmp = base_;
+         return (--tmp).operator->();
+       }
+
+       reverse_adaptor &operator++() {
+         --base_;
+         return *this;
+       }
+
+       reverse_adaptor operator++(int) {
+         reverse_adaptor tmp = *this;
+         --base_;
+         return tmp;
+       }
+
+       reverse_adaptor &operator--() {
+         ++base_;
+         return *this;
+       }
+
+       reverse_adaptor operator--(int) {
+         reverse_adaptor tmp = *this;
+         ++base_;
+         return tmp;
        }
+
+       bool operator==(const reverse_adaptor &rhs) const { return base_ == rhs.base_; }
+
+       bool operator!=(const reverse_adaptor &rhs) const { return base_ != rhs.base_; }
    };
 
+   /**
+  * the elements between two iterators of this map, see range().
+  * both ends are fixed when the view is made, so iterating it again costs
+  *   no searching and no key comparisons. erasing the element an end refers
+  *   to invalidates the view, like any other iterator.
+    */
+   template<class Iter>
+   class basic_range {
+      private:
+       Iter first, last;
+      public:
+       typedef Iter iterator;
+       typedef reverse_adaptor<Iter> reverse_iterator;
+
+       basic_range(Iter first, Iter last) : first(first), last(last) {}
+
+       Iter begin() const { return first; }
+
+       Iter end() const { return last; }
+
+       reverse_iterator rbegin() const { return reverse_iterator(last); }
+
+       reverse_iterator rend() const { return reverse_iterator(first); }
+
+       bool empty() const { return first == last; }
+
+       /**
+      * O(k) in the number of elements of the view; no subtree sizes are kept.
+        */
+       size_t size() const {
+         size_t n = 0;
+         for (const NodeBase* node = first.node_; node != last.node_; node = node->next) ++n;
+         return n;
+       }
+   };
+
+   typedef basic_range<iterator> range_type;
+   typedef basic_range<const_iterator> const_range_type;
+
   private:
    Compare comp;
    size_t size_;
 
-   struct Node {
+   /**
+  * besides the tree links every node is threaded into a circular in-order list
+  *   through the map's header: prev/next point to the predecessor/successor,
+  *   the header's next is the leftmost node and its prev the rightmost one.
+  * rotations never change the order, so only insert and erase touch them.
+    */
+   struct NodeBase {
+     NodeBase *prev, *next;
+     NodeBase() : prev(this), next(this) {}
+   };
+
+   typedef key_prefix<Key, Compare> prefix_type;
+   typedef typename prefix_type::probe probe_type;
+
+   struct Node : NodeBase, prefix_type::slot {
      char storage[sizeof(value_type)];
      Node *left, *right, *parent;
-     int color;  // 0: black, 1: red
-     Node() : left(nullptr), right(nullptr), parent(nullptr), color(0) {}
+     int rank;      // owned by Balance
+     unsigned aux;  // owned by Balance too; it fits in rank's padding
+     Node() : left(nullptr), right(nullptr), parent(nullptr), rank(0), aux(0) {}
      value_type* data() { return reinterpret_cast<value_type*>(storage); }
      const value_type* data() const { return reinterpret_cast<const value_type*>(storage); }
    };
 
+   /**
+  * storage for the first InlineNodes nodes inside the map object itself, so
+  *   that maps that stay that small never allocate. a node keeps its address
+  *   for as long as the map holds it, inline or not, so iterators behave the
+  *   same either way; slots freed by erase are taken again before the heap.
+  * nodes only leave their map through split() and join(), which copy any
+  *   that sit in the giving map's slots into nodes of the receiving map.
+  * the specialization for InlineNodes == 0 holds nothing.
+    */
+   template<size_t N, bool = (N > 0)>
+   struct node_pool {
+     static_assert(N <= 64, "InlineNodes is at most 64");
+     alignas(Node) unsigned char bytes[N * sizeof(Node)];
+     unsigned long long used;  // bit i is set while slot i holds a node
+
+     node_pool() : used(0) {}
+     node_pool(const node_pool&) = delete;
+     node_pool& operator=(const node_pool&) = delete;
+
+     Node* slot(size_t i) { return reinterpret_cast<Node*>(bytes) + i; }
+     bool in_use(size_t i) const { return (used >> i & 1) != 0; }
+
+     bool owns(const Node* node) const {
+       size_t address = reinterpret_cast<size_t>(node);
+       size_t begin = reinterpret_cast<size_t>(bytes);
+       return address >= begin && address < begin + sizeof(bytes);
+     }
+
+     // a node in a free slot, nullptr when all are taken
+     Node* allocate() {
+       size_t i = 0;
+       while (i < N && in_use(i)) ++i;
+       if (i == N) return nullptr;
+       used |= 1ULL << i;
+       return new (slot(i)) Node();
+     }
+
+     void release(Node* node) { used &= ~(1ULL << (node - slot(0))); }
+   };
+
+   template<size_t N>
+   struct node_pool<N, false> {
+     Node* slot(size_t) { return nullptr; }
+     bool in_use(size_t) const { return false; }
+     bool owns(const Node*) const { return false; }
+     Node* allocate() { return nullptr; }
+     void release(Node*) {}
+   };
+
+   /**
+  * the header holds no value and serves as end(); the tree itself still
+  *   ends in nullptr links, root has no parent.
+    */
+   NodeBase header;
    Node* root;
 
-   void destroy_node(Node* node) {
-     if (node == nullptr) return;
-     destroy_node(node->left);
-     destroy_node(node->right);
-     node->data()->~value_type();
-     delete node;
+   static Node* as_node(NodeBase* node) { return static_cast<Node*>(node); }
+
+   /**
+  * last-access finger: when enabled, the node touched by the latest
+  *   find/insert/operator[] on a non-const map, or nullptr.
+    */
+   bool finger_cache;
+   Node* last_touched;
+
+   /**
+  * optional bloom filter over the keys, see enable_bloom_filter().
+  * bloom_bits is nullptr while it is disabled.
+  * erase never clears bits, so the filter only gets less selective;
+  *   it is rebuilt from the tree once enough keys have been erased.
+    */
+   size_t (*bloom_hash)(const Key&);
+   unsigned long long* bloom_bits;
+   size_t bloom_mask;      // number of bits - 1
+   size_t bloom_capacity;  // keys the filter was sized for
+   size_t bloom_erased;    // erases since the last rebuild
+
+   // 10 bits per key and 5 probes give about 1% false positives
+   static const size_t bloom_bits_per_key = 10;
+   static const int bloom_probes = 5;
+
+   template<class Hash>
+   static size_t hash_key(const Key& key) { return Hash()(key); }
+
+   // splitmix64 finalizer, std::hash of integers is often the identity
+   static unsigned long long mix_hash(unsigned long long h) {
+     h ^= h >> 30;
+     h *= 0xbf58476d1ce4e5b9ULL;
+     h ^= h >> 27;
+     h *= 0x94d049bb133111ebULL;
+     h ^= h >> 31;
+     return h;
+   }
+
+   void bloom_set(const Key& key) {
+     unsigned long long h = mix_hash(bloom_hash(key));
+     size_t h1 = size_t(h), h2 = size_t(h >> 32) | 1;
+     for (int i = 0; i < bloom_probes; ++i) {
+       size_t bit = (h1 + i * h2) & bloom_mask;
+       bloom_bits[bit >> 6] |= 1ULL << (bit & 63);
+     }
+   }
+
+   bool bloom_may_contain(const Key& key) const {
+     if (bloom_bits == nullptr) return true;
+     unsigned long long h = mix_hash(bloom_hash(key));
+     size_t h1 = size_t(h), h2 = size_t(h >> 32) | 1;
+     for (int i = 0; i < bloom_probes; ++i) {
+       size_t bit = (h1 + i * h2) & bloom_mask;
+       if ((bloom_bits[bit >> 6] & (1ULL << (bit & 63))) == 0) return false;
+     }
+     return true;
+   }
+
+   void bloom_rebuild(size_t capacity) {
+     size_t bits = 64;
+     while (bits < capacity * bloom_bits_per_key) bits <<= 1;
+     unsigned long long* fresh = new unsigned long long[bits >> 6]();
+     delete[] bloom_bits;
+     bloom_bits = fresh;
+     bloom_mask = bits - 1;
+     bloom_capacity = capacity;
+     bloom_erased = 0;
+     for (NodeBase* node = header.next; node != &header; node = node->next)
+       bloom_set(as_node(node)->data()->first);
+   }
+
+   void copy_bloom(const map& other) {
+     bloom_hash = other.bloom_hash;
+     bloom_mask = other.bloom_mask;
+     bloom_capacity = other.bloom_capacity;
+     bloom_erased = other.bloom_erased;
+     if (other.bloom_bits != nullptr) {
+       bloom_bits = new unsigned long long[(bloom_mask + 1) >> 6];
+       memcpy(bloom_bits, other.bloom_bits, ((bloom_mask + 1) >> 6) * sizeof(unsigned long long));
+     }
+   }
+
+   /**
+  * optional open-addressing index from key hash to node, see enable_hash_index().
+  * linear probing with backward-shift deletion, so there are no tombstones;
+  *   the full hash is kept next to the node to skip most key comparisons.
+  * index_slots is nullptr while it is disabled.
+    */
+   struct HashSlot {
+     size_t hash;
+     Node* node;
+   };
+
+   size_t (*index_hash)(const Key&);
+   HashSlot* index_slots;
+   size_t index_mask;  // number of slots - 1, kept at most half full
+
+   size_t index_hash_of(const Key& key) const { return size_t(mix_hash(index_hash(key))); }
+
+   Node* index_find(const Key& key) const {
+     size_t h = index_hash_of(key);
+     for (size_t i = h & index_mask; index_slots[i].node != nullptr; i = (i + 1) & index_mask) {
+       Node* node = index_slots[i].node;
+       if (index_slots[i].hash == h && !comp(key, node->data()->first) && !comp(node->data()->first, key))
+         return node;
+     }
+     return nullptr;
+   }
+
+   void index_place(Node* node) {
+     size_t h = index_hash_of(node->data()->first);
+     size_t i = h & index_mask;
+     while (index_slots[i].node != nullptr) i = (i + 1) & index_mask;
+     index_slots[i].hash = h;
+     index_slots[i].node = node;
+   }
+
+   void index_remove(Node* node) {
+     size_t i = index_hash_of(node->data()->first) & index_mask;
+     while (index_slots[i].node != node) i = (i + 1) & index_mask;
+     for (size_t j = (i + 1) & index_mask; index_slots[j].node != nullptr; j = (j + 1) & index_mask) {
+       size_t home = index_slots[j].hash & index_mask;
+       // slot j may move back to i only if its home is not in (i, j]
+       bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+       if (!stays) {
+         index_slots[i] = index_slots[j];
+         i = j;
+       }
+     }
+     index_slots[i].node = nullptr;
+   }
+
+   void index_rebuild(size_t slots) {
+     while (slots < 2 * size_ + 2) slots <<= 1;
+     HashSlot* fresh = new HashSlot[slots]();
+     delete[] index_slots;
+     index_slots = fresh;
+     index_mask = slots - 1;
+     for (NodeBase* node = header.next; node != &header; node = node->next)
+       index_place(as_node(node));
+   }
+
+   void copy_hash_index(const map& other) {
+     index_hash = other.index_hash;
+     if (other.index_slots != nullptr) index_rebuild(other.index_mask + 1);
+   }
+
+   /**
+  * the radix tree over the keys when radix_key selects one. it is kept while
+  *   the map holds more than InlineNodes elements, and then answers point
+  *   lookups ahead of the hash index and the bloom filter; below that it
+  *   stays empty, so maps that fit in their inline nodes never allocate.
+  * for other keys radix_type is an empty stand-in.
+    */
+   typedef radix_index<Key, Compare, Node> radix_type;
+   radix_type radix;
+
+   node_pool<InlineNodes> pool;
+
+   Node* allocate_node() {
+     Node* node = pool.allocate();
+     return node != nullptr ? node : new Node();
+   }
+
+   // destroys the element too
+   void free_node(Node* node) {
+     node->data()->~value_type();
+     if (pool.owns(node)) pool.release(node);
+     else delete node;
+   }
+
+   /**
+  * replace node, which this map allocated, by a node of owner's holding the
+  *   same element at the same place in the tree rooted at tree_root and in
+  *   the thread, and in owner's radix tree if node is in it; node itself is
+  *   freed.
+    */
+   void relocate(Node* node, map& owner, Node*& tree_root) {
+     Node* moved = owner.allocate_node();
+     new (moved->storage) value_type(static_cast<value_type&&>(*node->data()));
+     static_cast<typename prefix_type::slot&>(*moved) = *node;
+     moved->rank = node->rank;
+     moved->aux = node->aux;
+     moved->left = node->left;
+     moved->right = node->right;
+     moved->parent = node->parent;
+     moved->prev = node->prev;
+     moved->next = node->next;
+     if (moved->parent == nullptr) tree_root = moved;
+     else if (moved->parent->left == node) moved->parent->left = moved;
+     else moved->parent->right = moved;
+     if (moved->left != nullptr) moved->left->parent = moved;
+     if (moved->right != nullptr) moved->right->parent = moved;
+     moved->prev->next = moved;
+     moved->next->prev = moved;
+     if (owner.radix_active()) owner.radix.replace(moved);
+     free_node(node);
+   }
+
+   bool radix_active() const { return radix_type::enabled && size_ > InlineNodes; }
+
+   void radix_rebuild() {
+     if (!radix_type::enabled) return;
+     radix.clear();
+     if (!radix_active()) return;
+     for (NodeBase* node = header.next; node != &header; node = node->next) radix.insert(as_node(node));
+   }
+
+   // whether point lookups are answered by an index rather than the tree
+   bool indexed() const { return radix_active() || index_slots != nullptr; }
+
+   Node* index_lookup(const Key& key) const {
+     return radix_active() ? radix.find(key) : index_find(key);
+   }
+
+   /**
+  * find_node from root, answering from an index when there is one,
+  *   and definite misses from the bloom filter first.
+    */
+   Node* lookup(const Key& key) const {
+     if (indexed()) return index_lookup(key);
+     if (!bloom_may_contain(key)) return nullptr;
+     return find_node(root, key);
+   }
+
+   /**
+  * the tree code below never recurses: a tree whose Balance has no
+  *   bounded_depth may be a single path of size() nodes.
+    */
+   void destroy_nodes() {
+     for (NodeBase* node = header.next; node != &header;) {
+       Node* dead = as_node(node);
+       node = node->next;
+       free_node(dead);
+     }
+   }
+
+   // empty the map after its nodes were freed or handed elsewhere
+   void forget_nodes() {
+     store_link(root, static_cast<Node*>(nullptr));
+     header.prev = header.next = &header;
+     last_touched = nullptr;
+     size_ = 0;
+     if (bloom_bits != nullptr) {
+       memset(bloom_bits, 0, ((bloom_mask + 1) >> 6) * sizeof(unsigned long long));
+       bloom_erased = 0;
+     }
+     if (index_slots != nullptr) memset(index_slots, 0, (index_mask + 1) * sizeof(HashSlot));
+     radix.clear();
+   }
+
+   /**
+  * take z out of the tree, the thread and the indexes without freeing it.
+    */
+   void detach(Node* z) {
+     if (last_touched == z) last_touched = nullptr;
+     if (index_slots != nullptr) index_remove(z);
+     if (radix_active()) {
+       if (size_ == InlineNodes + 1) radix.clear();
+       else radix.erase(z);
+     }
+     z->prev->next = z->next;
+     z->next->prev = z->prev;
+
+     Node* y = z;
+     Node* x = nullptr;
+     Node* x_parent = nullptr;
+     int removed_rank = y->rank;
+     if (z->left == nullptr) {
+       x = z->right;
+       x_parent = z->parent;
+       transplant(z, z->right);
+     } else if (z->right == nullptr) {
+       x = z->left;
+       x_parent = z->parent;
+       transplant(z, z->left);
+     } else {
+       y = as_node(z->next);
+       removed_rank = y->rank;
+       x = y->right;
+       if (y->parent == z) {
+         x_parent = y;
+         if (x != nullptr) x->parent = y;
+       } else {
+         transplant(y, y->right);
+         store_link(y->right, z->right);
+         y->right->parent = y;
+         x_parent = y->parent;
+       }
+       transplant(z, y);
+       store_link(y->left, z->left);
+       y->left->parent = y;
+       y->rank = z->rank;
+     }
+     size_--;
+     if (root != nullptr) Balance::after_erase(root, x, x_parent, removed_rank);
+     if (bloom_bits != nullptr && ++bloom_erased > bloom_capacity / 2) bloom_rebuild(bloom_capacity);
+   }
+
+   Node* clone_node(const Node* node, Node* parent) {
+     Node* new_node = allocate_node();
+     new (new_node->storage) value_type(*node->data());
+     prefix_type::store(*new_node, new_node->data()->first);
+     new_node->rank = node->rank;
+     new_node->aux = node->aux;
+     new_node->parent = parent;
+     return new_node;
+   }
+
+   /**
+  * copy other's tree shape for shape and thread the copy in the same walk,
+  *   which climbs back up through parent links instead of a stack.
+  * a copied node is still self-linked (prev == itself) until it gets threaded,
+  *   right after its left subtree is done.
+    */
+   void copy_from(const map& other) {
+     const Node* src = other.root;
+     Node* dst = root = clone_node(src, nullptr);
+     NodeBase* last = &header;
+     while (true) {
+       if (src->left != nullptr && dst->left == nullptr) {
+         dst->left = clone_node(src->left, dst);
+         src = src->left;
+         dst = dst->left;
+         continue;
+       }
+       if (dst->prev == dst) {
+         dst->prev = last;
+         last->next = dst;
+         last = dst;
+       }
+       if (src->right != nullptr && dst->right == nullptr) {
+         dst->right = clone_node(src->right, dst);
+         src = src->right;
+         dst = dst->right;
+         continue;
+       }
+       if (src == other.root) break;
+       src = src->parent;
+       dst = dst->parent;
+     }
+     last->next = &header;
+     header.prev = last;
+     size_ = other.size_;
+     radix_rebuild();
+   }
+
+   /**
+  * take over a tree of n nodes built elsewhere (see parallel_bulk_load),
+  *   replacing an empty one: nodes come from new and are linked, ranked and
+  *   threaded to each other, only the ends of the thread are left to this.
+    */
+   void adopt(Node* tree, size_t n) {
+     root = tree;
+     size_ = n;
+     last_touched = nullptr;
+     if (tree != nullptr) {
+       Node* first = tree;
+       Node* last = tree;
+       while (first->left != nullptr) first = first->left;
+       while (last->right != nullptr) last = last->right;
+       first->prev = &header;
+       header.next = first;
+       last->next = &header;
+       header.prev = last;
+     }
+     if (bloom_bits != nullptr) bloom_rebuild(size_ > bloom_capacity ? size_ : bloom_capacity);
+     if (index_slots != nullptr) index_rebuild(16);
+     radix_rebuild();
+   }
+
+   /**
+  * comp(probe.key, node's key) and comp(node's key, probe.key),
+  *   settled by the inline key prefixes when those differ.
+    */
+   bool probe_less(const probe_type& probe, const Node* node) const {
+     int order = prefix_type::order(probe, *node);
+     return order != 0 ? order < 0 : comp(probe.key, node->data()->first);
    }
 
-   Node* copy_tree(Node* node, Node* parent) {
-     if (node == nullptr) return nullptr;
-     Node* new_node = new Node();
-     new (new_node->storage) value_type(*node->data());
-     new_node->color = node->color;
-     new_node->parent = parent;
-     new_node->left = copy_tree(node->left, new_node);
-     new_node->right = copy_tree(node->right, new_node);
-     return new_node;
+   bool probe_greater(const probe_type& probe, const Node* node) const {
+     int order = prefix_type::order(probe, *node);
+     return order != 0 ? order > 0 : comp(node->data()->first, probe.key);
    }
 
    Node* find_node(Node* node, const Key& key) const {
+     probe_type probe(key);
      while (node != nullptr) {
-       if (!comp(key, node->data()->first) && !comp(node->data()->first, key))
-         return node;
-       if (comp(key, node->data()->first))
+       if (probe_less(probe, node))
          node = node->left;
+       else if (probe_greater(probe, node))
+         node = node->right;
        else
+         return node;
+     }
+     return nullptr;
+   }
+
+   /**
+  * like find_node, but on a miss reports where key would be attached:
+  *   parent is the last node visited and go_left tells which child slot is free.
+    */
+   Node* descend(Node* node, const Key& key, Node*& parent, bool& go_left) const {
+     probe_type probe(key);
+     parent = nullptr;
+     go_left = false;
+     while (node != nullptr) {
+       parent = node;
+       if (probe_less(probe, node)) {
+         go_left = true;
+         node = node->left;
+       } else if (probe_greater(probe, node)) {
+         go_left = false;
          node = node->right;
+       } else {
+         return node;
+       }
+     }
+     return nullptr;
+   }
+
+   /**
+  * the lowest of u and its ancestors whose subtree is known to cover key,
+  *   found by climbing parent links.
+  * only one bound has to be checked on the way up, because key already lies
+  *   on one side of the current node: u is kept as soon as key is below the
+  *   first ancestor reached through a left link (or above the first reached
+  *   through a right link), so the climb is only as high as the distance
+  *   between u's key and key requires.
+    */
+   Node* climb(Node* u, const Key& key) const {
+     if (comp(u->data()->first, key)) {
+       while (true) {
+         Node* c = u;
+         Node* p = c->parent;
+         while (p != nullptr && c == p->right) {
+           c = p;
+           p = p->parent;
+         }
+         if (p == nullptr || comp(key, p->data()->first)) return u;
+         if (!comp(p->data()->first, key)) return p;
+         u = p;
+       }
+     }
+     if (comp(key, u->data()->first)) {
+       while (true) {
+         Node* c = u;
+         Node* p = c->parent;
+         while (p != nullptr && c == p->left) {
+           c = p;
+           p = p->parent;
+         }
+         if (p == nullptr || comp(p->data()->first, key)) return u;
+         if (!comp(key, p->data()->first)) return p;
+         u = p;
+       }
+     }
+     return u;
+   }
+
+   /**
+  * the node to start descending from when searching for key:
+  *   root, or with the finger cache enabled climb(last_touched, key).
+    */
+   Node* descent_start(const Key& key) const {
+     Node* u = finger_cache ? last_touched : nullptr;
+     return u != nullptr ? climb(u, key) : root;
+   }
+
+   /**
+  * search for key starting from finger instead of root: climb from finger
+  *   to the lowest ancestor whose subtree covers key, then descend.
+  * finger is updated to the last node visited so that the next probe can reuse it.
+    */
+   Node* finger_find_node(Node*& finger, const Key& key) const {
+     Node* node = climb(finger, key);
+     probe_type probe(key);
+     while (node != nullptr) {
+       finger = node;
+       if (probe_less(probe, node)) node = node->left;
+       else if (probe_greater(probe, node)) node = node->right;
+       else return node;
      }
      return nullptr;
    }
 
    Node* lower_bound_node(Node* node, const Key& key) const {
+     probe_type probe(key);
      Node* result = nullptr;
      while (node != nullptr) {
-       if (!comp(node->data()->first, key)) {
+       if (!probe_greater(probe, node)) {
          result = node;
          node = node->left;
        } else {
@@ -251,220 +1943,191 @@ template<
      return result;
    }
 
-   void left_rotate(Node* x) {
-     Node* y = x->right;
-     x->right = y->left;
-     if (y->left != nullptr) y->left->parent = x;
-     y->parent = x->parent;
-     if (x->parent == nullptr) root = y;
-     else if (x == x->parent->left) x->parent->left = y;
-     else x->parent->right = y;
-     y->left = x;
-     x->parent = y;
+   // lower_bound as a position in the thread, &header when every key is less than key
+   NodeBase* lower_bound_base(const Key& key) const {
+     Node* node = lower_bound_node(root, key);
+     return node != nullptr ? node : const_cast<NodeBase*>(&header);
    }
 
-   void right_rotate(Node* x) {
-     Node* y = x->left;
-     x->left = y->right;
-     if (y->right != nullptr) y->right->parent = x;
-     y->parent = x->parent;
-     if (x->parent == nullptr) root = y;
-     else if (x == x->parent->right) x->parent->right = y;
-     else x->parent->left = y;
-     y->right = x;
-     x->parent = y;
+   /**
+  * write the nodes of the top depth levels of the tree to out in key order.
+  * together with header.next and &header they cut the thread into ranges
+  *   of one separator plus one subtree each, which is how parallel traversal
+  *   splits the map; out needs room for 2^depth - 1 nodes.
+    */
+   void top_nodes(Node* node, size_t depth, NodeBase**& out) const {
+     if (node == nullptr || depth == 0) return;
+     top_nodes(node->left, depth - 1, out);
+     *out++ = node;
+     top_nodes(node->right, depth - 1, out);
    }
 
-   void insert_fixup(Node* z) {
-     while (z->parent != nullptr && z->parent->color == 1) {
-       if (z->parent->parent != nullptr && z->parent == z->parent->parent->left) {
-         Node* y = z->parent->parent->right;
-         if (y != nullptr && y->color == 1) {
-           z->parent->color = 0;
-           y->color = 0;
-           z->parent->parent->color = 1;
-           z = z->parent->parent;
-         } else {
-           if (z == z->parent->right) {
-             z = z->parent;
-             left_rotate(z);
-           }
-           z->parent->color = 0;
-           if (z->parent->parent != nullptr) {
-             z->parent->parent->color = 1;
-             right_rotate(z->parent->parent);
-           }
-         }
-       } else if (z->parent->parent != nullptr) {
-         Node* y = z->parent->parent->left;
-         if (y != nullptr && y->color == 1) {
-           z->parent->color = 0;
-           y->color = 0;
-           z->parent->parent->color = 1;
-           z = z->parent->parent;
-         } else {
-           if (z == z->parent->left) {
-             z = z->parent;
-             right_rotate(z);
-           }
-           z->parent->color = 0;
-           if (z->parent->parent != nullptr) {
-             z->parent->parent->color = 1;
-             left_rotate(z->parent->parent);
-           }
-         }
-       } else break;
+   /**
+  * call f on one element; a visitor returning something convertible to bool
+  *   stops the traversal by returning false, a void visitor never stops it.
+    */
+   template<class F, class V>
+   static auto visit(F& f, V& value, int) -> decltype(bool(f(value))) { return bool(f(value)); }
+
+   template<class F, class V>
+   static bool visit(F& f, V& value, long) {
+     f(value);
+     return true;
+   }
+
+   template<class V, class F>
+   static bool visit_range(NodeBase* first, NodeBase* last, F& f) {
+     for (NodeBase* node = first; node != last; node = node->next) {
+       V& value = *as_node(node)->data();
+       if (!visit(f, value, 0)) return false;
      }
-     root->color = 0;
+     return true;
    }
 
-   void erase_fixup(Node* x, Node* x_parent) {
-     while (x != root && (x == nullptr || x->color == 0)) {
-       if (x_parent != nullptr && x == x_parent->left) {
-         Node* w = x_parent->right;
-         if (w != nullptr && w->color == 1) {
-           w->color = 0;
-           x_parent->color = 1;
-           left_rotate(x_parent);
-           w = x_parent->right;
-         }
-         if (w != nullptr && (w->left == nullptr || w->left->color == 0) &&
-             (w->right == nullptr || w->right->color == 0)) {
-           w->color = 1;
-           x = x_parent;
-           x_parent = x->parent;
-         } else if (w != nullptr) {
-           if (w->right == nullptr || w->right->color == 0) {
-             if (w->left != nullptr) w->left->color = 0;
-             w->color = 1;
-             right_rotate(w);
-             w = x_parent->right;
-           }
-           w->color = x_parent->color;
-           x_parent->color = 0;
-           if (w->right != nullptr) w->right->color = 0;
-           left_rotate(x_parent);
-           x = root;
-           x_parent = nullptr;
-         } else break;
-       } else if (x_parent != nullptr) {
-         Node* w = x_parent->left;
-         if (w != nullptr && w->color == 1) {
-           w->color = 0;
-           x_parent->color = 1;
-           right_rotate(x_parent);
-           w = x_parent->left;
-         }
-         if (w != nullptr && (w->right == nullptr || w->right->color == 0) &&
-             (w->left == nullptr || w->left->color == 0)) {
-           w->color = 1;
-           x = x_parent;
-           x_parent = x->parent;
-         } else if (w != nullptr) {
-           if (w->left == nullptr || w->left->color == 0) {
-             if (w->right != nullptr) w->right->color = 0;
-             w->color = 1;
-             left_rotate(w);
-             w = x_parent->left;
-           }
-           w->color = x_parent->color;
-           x_parent->color = 0;
-           if (w->left != nullptr) w->left->color = 0;
-           right_rotate(x_parent);
-           x = root;
-           x_parent = nullptr;
-         } else break;
-       } else break;
+   /**
+  * visit_range for maps much larger than the cache, visiting the elements
+  *   from lower_bound(*lo) (the leftmost one if lo is nullptr) up to last.
+  * following next is one dependent load per element: when nodes are scattered
+  *   over the heap every step waits for a cache miss. this walks the tree with
+  *   an explicit stack instead, so the address of the next node to visit is
+  *   usually known without waiting for the current one and several misses can
+  *   be in flight; a node's right child is also prefetched as soon as the node
+  *   is pushed, long before the walk gets there.
+  * with a bounded_depth policy a tree of 2^64 nodes is less than 128 levels
+  *   deep, so the stack never needs the heap; other trees follow the threads.
+    */
+   static const int scan_stack_depth = 128;
+
+   template<class V, class F>
+   bool scan_range(const Key* lo, const NodeBase* last, F& f) const {
+     if (!Balance::bounded_depth)
+       return visit_range<V>(lo != nullptr ? lower_bound_base(*lo) : header.next, const_cast<NodeBase*>(last), f);
+     Node* stack[scan_stack_depth];
+     int top = 0;
+     for (Node* node = root; node != nullptr;) {
+       if (lo == nullptr || !comp(node->data()->first, *lo)) {
+         stack[top++] = node;
+         SJTU_MAP_PREFETCH(node->right);
+         node = node->left;
+       } else {
+         node = node->right;
+       }
+     }
+     while (top > 0) {
+       Node* node = stack[--top];
+       if (node == last) break;
+       V& value = *node->data();
+       if (!visit(f, value, 0)) return false;
+       for (Node* child = node->right; child != nullptr; child = child->left) {
+         stack[top++] = child;
+         SJTU_MAP_PREFETCH(child->right);
+       }
      }
-     if (x != nullptr) x->color = 0;
+     return true;
+   }
+
+   // a lookup on a non-const map ended at node: move the finger and let Balance adjust
+   void touch(Node* node) {
+     last_touched = node;
+     Balance::after_access(root, node);
    }
 
    void transplant(Node* u, Node* v) {
-     if (u->parent == nullptr) root = v;
-     else if (u == u->parent->left) u->parent->left = v;
-     else u->parent->right = v;
+     if (u->parent == nullptr) store_link(root, v);
+     else if (u == u->parent->left) store_link(u->parent->left, v);
+     else store_link(u->parent->right, v);
      if (v != nullptr) v->parent = u->parent;
    }
 
-   Node* minimum(Node* node) const {
-     if (node == nullptr) return nullptr;
-     while (node->left != nullptr) node = node->left;
-     return node;
-   }
 
-   Node* maximum(Node* node) const {
-     if (node == nullptr) return nullptr;
-     while (node->right != nullptr) node = node->right;
-     return node;
-   }
 
-   Node* successor_node(Node* node) const {
-     if (node == nullptr) return nullptr;
-     if (node->right != nullptr) return minimum(node->right);
-     Node* p = node->parent;
-     while (p != nullptr && node == p->right) {
-       node = p;
-       p = p->parent;
-     }
-     return p;
+  public:
+   /**
+  * TODO two constructors
+    */
+   map()
+       : size_(0), root(nullptr), finger_cache(false), last_touched(nullptr),
+         bloom_hash(nullptr), bloom_bits(nullptr), bloom_mask(0), bloom_capacity(0), bloom_erased(0),
+         index_hash(nullptr), index_slots(nullptr), index_mask(0) {}
+
+   map(const map &other)
+       : size_(0), root(nullptr), finger_cache(other.finger_cache), last_touched(nullptr),
+         bloom_hash(nullptr), bloom_bits(nullptr), bloom_mask(0), bloom_capacity(0), bloom_erased(0),
+         index_hash(nullptr), index_slots(nullptr), index_mask(0) {
+     if (other.root != nullptr) copy_from(other);
+     copy_bloom(other);
+     copy_hash_index(other);
    }
 
-   const Node* successor_node(const Node* node) const {
-     if (node == nullptr) return nullptr;
-     if (node->right != nullptr) return minimum(node->right);
-     const Node* p = node->parent;
-     while (p != nullptr && node == p->right) {
-       node = p;
-       p = p->parent;
-     }
-     return p;
+   /**
+  * turn the last-access finger cache on or off.
+  * while it is on, find/insert/operator[] on a non-const map start their
+  *   search near the previously touched node, which pays off when
+  *   consecutive keys are close to each other (sliding windows, scans with updates).
+  * const lookups never use or move the finger.
+    */
+   void set_finger_cache(bool enabled) {
+     finger_cache = enabled;
+     last_touched = nullptr;
    }
 
-   Node* predecessor_node(Node* node) const {
-     if (node == nullptr) return nullptr;
-     if (node->left != nullptr) return maximum(node->left);
-     Node* p = node->parent;
-     while (p != nullptr && node == p->left) {
-       node = p;
-       p = p->parent;
-     }
-     return p;
+   bool finger_cache_enabled() const { return finger_cache; }
+
+   /**
+  * keep a bloom filter over the keys so that find/count/at/operator[]
+  *   can answer most misses without descending the tree.
+  * Hash must be default-constructible and is only instantiated here,
+  *   so maps whose key has no hash are unaffected unless they call this.
+  * expected is the number of keys to size the filter for; it grows by
+  *   doubling once size() passes it, and is rebuilt after many erases.
+    */
+   template<class Hash = std::hash<Key>>
+   void enable_bloom_filter(size_t expected = 0) {
+     bloom_hash = &hash_key<Hash>;
+     bloom_rebuild(expected > size_ ? expected : (size_ > 64 ? size_ : 64));
    }
 
-   const Node* predecessor_node(const Node* node) const {
-     if (node == nullptr) return nullptr;
-     if (node->left != nullptr) return maximum(node->left);
-     const Node* p = node->parent;
-     while (p != nullptr && node == p->left) {
-       node = p;
-       p = p->parent;
-     }
-     return p;
+   void disable_bloom_filter() {
+     delete[] bloom_bits;
+     bloom_bits = nullptr;
+     bloom_hash = nullptr;
    }
 
-  public:
+   bool bloom_filter_enabled() const { return bloom_bits != nullptr; }
+
    /**
-  * TODO two constructors
+  * maintain a hash index next to the tree so that find/count/at/operator[]
+  *   are expected O(1); ordered operations still use the tree.
+  * the same Hash requirements as enable_bloom_filter() apply.
+  * with the index enabled the bloom filter and the finger cache are bypassed
+  *   for point lookups, since the index already answers them directly.
     */
-   map() : size_(0), root(nullptr) {}
+   template<class Hash = std::hash<Key>>
+   void enable_hash_index() {
+     index_hash = &hash_key<Hash>;
+     index_rebuild(16);
+   }
 
-   map(const map &other) : size_(0), root(nullptr) {
-     if (other.root != nullptr) {
-       root = copy_tree(other.root, nullptr);
-       size_ = other.size_;
-     }
+   void disable_hash_index() {
+     delete[] index_slots;
+     index_slots = nullptr;
+     index_hash = nullptr;
    }
 
+   bool hash_index_enabled() const { return index_slots != nullptr; }
+
    /**
   * TODO assignment operator
     */
    map &operator=(const map &other) {
      if (this != &other) {
        clear();
-       if (other.root != nullptr) {
-         root = copy_tree(other.root, nullptr);
-         size_ = other.size_;
-       }
+       disable_bloom_filter();
+       disable_hash_index();
+       finger_cache = other.finger_cache;
+       if (other.root != nullptr) copy_from(other);
+       copy_bloom(other);
+       copy_hash_index(other);
      }
      return *this;
    }
@@ -472,7 +2135,11 @@ template<
    /**
   * TODO Destructors
     */
-   ~map() { clear(); }
+   ~map() {
+     clear();
+     delete[] bloom_bits;
+     delete[] index_slots;
+   }
 
    /**
   * TODO
@@ -481,13 +2148,14 @@ template<
   * If no such element exists, an exception of type `index_out_of_bound'
     */
    T &at(const Key &key) {
-     Node* node = find_node(root, key);
+     Node* node = lookup(key);
      if (node == nullptr) throw index_out_of_bound();
+     Balance::after_access(root, node);
      return node->data()->second;
    }
 
    const T &at(const Key &key) const {
-     Node* node = find_node(root, key);
+     Node* node = lookup(key);
      if (node == nullptr) throw index_out_of_bound();
      return node->data()->second;
    }
@@ -499,11 +2167,16 @@ template<
   *   performing an insertion if such key does not already exist.
     */
    T &operator[](const Key &key) {
-     Node* node = find_node(root, key);
-     if (node != nullptr) return node->data()->second;
+     Node* node;
+     if (indexed()) node = index_lookup(key);
+     else node = bloom_may_contain(key) ? find_node(descent_start(key), key) : nullptr;
+     if (node != nullptr) {
+       touch(node);
+       return node->data()->second;
+     }
      value_type val(key, T());
      auto pr = insert(val);
-     return pr.first.node_->data()->second;
+     return as_node(pr.first.node_)->data()->second;
    }
 
    /**
@@ -516,23 +2189,17 @@ template<
    /**
   * return a iterator to the beginning
     */
-   iterator begin() {
-     if (root == nullptr) return iterator(nullptr, this);
-     return iterator(minimum(root), this);
-   }
+   iterator begin() { return iterator(header.next, this); }
 
-   const_iterator cbegin() const {
-     if (root == nullptr) return const_iterator(nullptr, this);
-     return const_iterator(minimum(root), this);
-   }
+   const_iterator cbegin() const { return const_iterator(header.next, this); }
 
    /**
   * return a iterator to the end
   * in fact, it returns past-the-end.
     */
-   iterator end() { return iterator(nullptr, this); }
+   iterator end() { return iterator(&header, this); }
 
-   const_iterator cend() const { return const_iterator(nullptr, this); }
+   const_iterator cend() const { return const_iterator(&header, this); }
 
    /**
   * checks whether the container is empty
@@ -549,9 +2216,8 @@ template<
   * clears the contents
     */
    void clear() {
-     destroy_node(root);
-     root = nullptr;
-     size_ = 0;
+     destroy_nodes();
+     forget_nodes();
    }
 
    /**
@@ -561,25 +2227,49 @@ template<
   *   the second one is true if insert successfully, or false.
     */
    pair<iterator, bool> insert(const value_type &value) {
-     Node* exist = find_node(root, value.first);
-     if (exist != nullptr) return pair<iterator, bool>(iterator(exist, this), false);
+     Node* y;
+     bool go_left;
+     Node* exist = indexed() ? index_lookup(value.first) : nullptr;
+     if (exist == nullptr) exist = descend(descent_start(value.first), value.first, y, go_left);
+     if (exist != nullptr) {
+       touch(exist);
+       return pair<iterator, bool>(iterator(exist, this), false);
+     }
 
-     Node* z = new Node();
+     Node* z = allocate_node();
      new (z->storage) value_type(value);
-     z->color = 1;
-     Node* y = nullptr;
-     Node* x = root;
-     while (x != nullptr) {
-       y = x;
-       if (comp(z->data()->first, x->data()->first)) x = x->left;
-       else x = x->right;
-     }
+     prefix_type::store(*z, z->data()->first);
+     z->rank = Balance::new_rank;
      z->parent = y;
-     if (y == nullptr) root = z;
-     else if (comp(z->data()->first, y->data()->first)) y->left = z;
-     else y->right = z;
-     insert_fixup(z);
+     if (y == nullptr) {
+       store_link(root, z);
+       z->prev = z->next = &header;
+     } else if (go_left) {
+       store_link(y->left, z);
+       z->next = y;
+       z->prev = y->prev;
+     } else {
+       store_link(y->right, z);
+       z->prev = y;
+       z->next = y->next;
+     }
+     z->prev->next = z;
+     z->next->prev = z;
+     Balance::after_insert(root, z);
      size_++;
+     last_touched = z;
+     if (bloom_bits != nullptr) {
+       if (size_ > bloom_capacity) bloom_rebuild(bloom_capacity * 2);
+       else bloom_set(z->data()->first);
+     }
+     if (index_slots != nullptr) {
+       if (2 * size_ > index_mask) index_rebuild(2 * (index_mask + 1));
+       else index_place(z);
+     }
+     if (radix_active()) {
+       if (size_ == InlineNodes + 1) radix_rebuild();
+       else radix.insert(z);
+     }
      return pair<iterator, bool>(iterator(z, this), true);
    }
 
@@ -589,45 +2279,134 @@ template<
   * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
     */
    void erase(iterator pos) {
-     if (pos.owner != this || pos.node_ == nullptr) throw invalid_iterator();
-     Node* z = pos.node_;
+     if ((checked_iterators && pos.get() != this) || pos.node_ == &header) throw invalid_iterator();
+     Node* z = as_node(pos.node_);
+     detach(z);
+     free_node(z);
+   }
 
-     Node* y = z;
-     Node* x = nullptr;
-     Node* x_parent = nullptr;
-     int y_orig_color = y->color;
-     if (z->left == nullptr) {
-       x = z->right;
-       x_parent = z->parent;
-       transplant(z, z->right);
-     } else if (z->right == nullptr) {
-       x = z->left;
-       x_parent = z->parent;
-       transplant(z, z->left);
-     } else {
-       y = minimum(z->right);
-       y_orig_color = y->color;
-       x = y->right;
-       if (y->parent == z) {
-         x_parent = y;
-         if (x != nullptr) x->parent = y;
+   /**
+  * move every element whose key is not less than key into other,
+  *   whose previous contents are destroyed.
+  * only for a joinable Balance (treap_balance), where it takes O(log n)
+  *   expected: the tree is cut along one path and the thread at one node.
+  * iterators to elements that stay remain valid; iterators to moved elements
+  *   must not be used, find them again in other. a hash index on either map
+  *   is rebuilt, which is O(size()); the radix tree stays with the larger
+  *   part and the keys of the smaller one move, O(min(size(), other.size())).
+    */
+   void split(const Key &key, map &other) {
+     static_assert(Balance::joinable, "split() needs a joinable Balance such as treap_balance");
+     if (&other == this) throw runtime_error();
+     other.clear();
+     NodeBase* first = lower_bound_base(key);
+     if (first == &header) return;
+     last_touched = nullptr;
+     Node* left;
+     Node* right;
+     Balance::split(root, [this, &key](const Node* node) { return comp(node->data()->first, key); }, left, right);
+     root = left;
+     other.root = right;
+     NodeBase* last = first->prev;
+     other.header.next = first;
+     first->prev = &other.header;
+     other.header.prev = header.prev;
+     header.prev->next = &other.header;
+     last->next = &header;
+     header.prev = last;
+     other.size_ = right->rank;
+     size_ -= other.size_;
+     if (radix_type::enabled && size_ + other.size_ > InlineNodes) {
+       if (other.size_ > size_) {
+         radix.swap(other.radix);
+         for (NodeBase* node = header.next; node != &header; node = node->next) {
+           other.radix.erase(as_node(node));
+           if (radix_active()) radix.insert(as_node(node));
+         }
+         if (!other.radix_active()) other.radix.clear();
        } else {
-         transplant(y, y->right);
-         y->right = z->right;
-         y->right->parent = y;
-         x_parent = y->parent;
+         if (!radix_active()) radix.clear();
+         for (NodeBase* node = other.header.next; node != &other.header; node = node->next) {
+           if (radix_active()) radix.erase(as_node(node));
+           if (other.radix_active()) other.radix.insert(as_node(node));
+         }
        }
-       transplant(z, y);
-       y->left = z->left;
-       y->left->parent = y;
-       y->color = z->color;
      }
-     z->data()->~value_type();
-     delete z;
-     size_--;
-     if (y_orig_color == 0 && root != nullptr) {
-       erase_fixup(x, x_parent);
+     for (size_t i = 0; i < InlineNodes; ++i)
+       if (pool.in_use(i) && !comp(pool.slot(i)->data()->first, key)) relocate(pool.slot(i), other, other.root);
+     // moved keys only make the filter less selective, as erased ones do
+     if (bloom_bits != nullptr && (bloom_erased += other.size_) > bloom_capacity / 2) bloom_rebuild(bloom_capacity);
+     if (index_slots != nullptr) index_rebuild(16);
+     if (other.bloom_bits != nullptr)
+       other.bloom_rebuild(other.size_ > other.bloom_capacity ? other.size_ : other.bloom_capacity);
+     if (other.index_slots != nullptr) other.index_rebuild(16);
+   }
+
+   /**
+  * split() by position instead of key: the first count elements in key order
+  *   stay, the rest move into other. the key to split at is found through the
+  *   subtree sizes a joinable Balance keeps, so this is O(log n) expected too.
+    */
+   void split_at(size_t count, map &other) {
+     static_assert(Balance::joinable, "split_at() needs a joinable Balance such as treap_balance");
+     if (count >= size_) {
+       if (&other == this) throw runtime_error();
+       other.clear();
+       return;
+     }
+     Node* node = root;
+     size_t rank = count;
+     while (true) {
+       size_t left = Balance::size(node->left);
+       if (rank < left) {
+         node = node->left;
+       } else if (rank == left) {
+         break;
+       } else {
+         rank -= left + 1;
+         node = node->right;
+       }
+     }
+     // a copy: split() may move the node holding it
+     Key key(node->data()->first);
+     split(key, other);
+   }
+
+   /**
+  * move all elements of other to the end of this map, leaving other empty.
+  * every key in other must be greater than every key here,
+  *   otherwise runtime_error is thrown and neither map changes.
+  * same requirements, cost and iterator rules as split(); a bloom filter
+  *   here is rebuilt too.
+    */
+   void join(map &other) {
+     static_assert(Balance::joinable, "join() needs a joinable Balance such as treap_balance");
+     if (other.root == nullptr) return;
+     if (root != nullptr && !comp(as_node(header.prev)->data()->first, as_node(other.header.next)->data()->first))
+       throw runtime_error();
+     root = Balance::join(root, other.root);
+     NodeBase* last = header.prev;
+     size_t old_size = size_;
+     last->next = other.header.next;
+     other.header.next->prev = last;
+     header.prev = other.header.prev;
+     header.prev->next = &header;
+     size_ += other.size_;
+     other.root = nullptr;
+     other.header.prev = other.header.next = &other.header;
+     if (other.radix_active() && other.size_ > old_size) {
+       radix.swap(other.radix);
+       for (NodeBase* node = header.next; node != last->next; node = node->next) radix.insert(as_node(node));
+     } else if (radix_active() && old_size <= InlineNodes) {
+       radix_rebuild();
+     } else if (radix_active()) {
+       for (NodeBase* node = last->next; node != &header; node = node->next) radix.insert(as_node(node));
      }
+     for (size_t i = 0; i < InlineNodes; ++i)
+       if (other.pool.in_use(i)) other.relocate(other.pool.slot(i), *this, root);
+     other.clear();
+     if (bloom_bits != nullptr) bloom_rebuild(size_ > bloom_capacity ? size_ : bloom_capacity);
+     if (index_slots != nullptr) index_rebuild(16);
    }
 
    /**
@@ -638,7 +2417,7 @@ template<
   * The default method of check the equivalence is !(a < b || b > a)
     */
    size_t count(const Key &key) const {
-     return find_node(root, key) != nullptr ? 1 : 0;
+     return lookup(key) != nullptr ? 1 : 0;
    }
 
    /**
@@ -648,16 +2427,161 @@ template<
   *   If no such element is found, past-the-end (see end()) iterator is returned.
     */
    iterator find(const Key &key) {
-     Node* node = find_node(root, key);
-     if (node == nullptr) return end();
+     if (indexed()) {
+       Node* node = index_lookup(key);
+       if (node == nullptr) return end();
+       touch(node);
+       return iterator(node, this);
+     }
+     if (!bloom_may_contain(key)) return end();
+     Node* parent;
+     bool go_left;
+     Node* node = descend(descent_start(key), key, parent, go_left);
+     if (node == nullptr) {
+       if (parent != nullptr) touch(parent);
+       return end();
+     }
+     touch(node);
      return iterator(node, this);
    }
 
+   /**
+  * the first element whose key is not less than key, or end().
+    */
+   iterator lower_bound(const Key &key) {
+     return iterator(lower_bound_base(key), this);
+   }
+
+   const_iterator lower_bound(const Key &key) const {
+     return const_iterator(lower_bound_base(key), this);
+   }
+
+   /**
+  * a view of the elements whose keys lie in [lo, hi), empty unless lo < hi.
+  * both ends are looked up once here; iterate it forwards or with
+  *   rbegin()/rend() as often as needed.
+    */
+   range_type range(const Key &lo, const Key &hi) {
+     iterator first = lower_bound(lo);
+     return range_type(first, comp(lo, hi) ? lower_bound(hi) : first);
+   }
+
+   const_range_type range(const Key &lo, const Key &hi) const {
+     const_iterator first = lower_bound(lo);
+     return const_range_type(first, comp(lo, hi) ? lower_bound(hi) : first);
+   }
+
    const_iterator find(const Key &key) const {
-     Node* node = find_node(root, key);
+     Node* node = lookup(key);
      if (node == nullptr) return cend();
      return const_iterator(node, this);
    }
+
+   /**
+  * batch version of find() for keys sorted in ascending order.
+  * writes find(key) for every key in [first, last) to out and returns out.
+  * each probe starts from the node reached by the previous one,
+  *   so m sorted probes cost O(m log(n/m)) instead of O(m log n).
+  * an out-of-order key is still answered correctly, it just restarts from root.
+    */
+   template<class ForwardIt, class OutputIt>
+   OutputIt find_sorted(ForwardIt first, ForwardIt last, OutputIt out) {
+     Node* finger = root;
+     for (ForwardIt prev = first; first != last; prev = first, ++first) {
+       if (finger == nullptr) {
+         *out = end();
+       } else {
+         if (comp(*first, *prev)) finger = root;
+         Node* node = finger_find_node(finger, *first);
+         *out = node == nullptr ? end() : iterator(node, this);
+       }
+       ++out;
+     }
+     return out;
+   }
+
+   template<class ForwardIt, class OutputIt>
+   OutputIt find_sorted(ForwardIt first, ForwardIt last, OutputIt out) const {
+     Node* finger = root;
+     for (ForwardIt prev = first; first != last; prev = first, ++first) {
+       if (finger == nullptr) {
+         *out = cend();
+       } else {
+         if (comp(*first, *prev)) finger = root;
+         Node* node = finger_find_node(finger, *first);
+         *out = node == nullptr ? cend() : const_iterator(node, this);
+       }
+       ++out;
+     }
+     return out;
+   }
+
+   /**
+  * apply f to every element in key order, without going through iterators.
+  * if f returns a value it is taken as "continue": returning false stops the
+  *   traversal early and makes for_each return false, otherwise it returns true.
+  * f must not insert into or erase from this map.
+    */
+   template<class F>
+   bool for_each(F f) {
+     return visit_range<value_type>(header.next, &header, f);
+   }
+
+   template<class F>
+   bool for_each(F f) const {
+     return visit_range<const value_type>(header.next, const_cast<NodeBase*>(&header), f);
+   }
+
+   /**
+  * same as above, restricted to the elements whose keys lie in [lo, hi).
+    */
+   template<class F>
+   bool for_each(const Key &lo, const Key &hi, F f) {
+     if (!comp(lo, hi)) return true;
+     return visit_range<value_type>(lower_bound_base(lo), lower_bound_base(hi), f);
+   }
+
+   template<class F>
+   bool for_each(const Key &lo, const Key &hi, F f) const {
+     if (!comp(lo, hi)) return true;
+     return visit_range<const value_type>(lower_bound_base(lo), lower_bound_base(hi), f);
+   }
+
+   /**
+  * for_each for large maps whose nodes are scattered over the heap (keys not
+  *   inserted in order): same contract, but the tree is walked so that several
+  *   upcoming nodes are fetched while the current one is visited.
+  * when nodes were allocated in key order for_each is faster.
+    */
+   template<class F>
+   bool scan(F f) {
+     return scan_range<value_type>(nullptr, &header, f);
+   }
+
+   template<class F>
+   bool scan(F f) const {
+     return scan_range<const value_type>(nullptr, &header, f);
+   }
+
+   template<class F>
+   bool scan(const Key &lo, const Key &hi, F f) {
+     if (!comp(lo, hi)) return true;
+     return scan_range<value_type>(&lo, lower_bound_base(hi), f);
+   }
+
+   template<class F>
+   bool scan(const Key &lo, const Key &hi, F f) const {
+     if (!comp(lo, hi)) return true;
+     return scan_range<const value_type>(&lo, lower_bound_base(hi), f);
+   }
+
+   /**
+  * an immutable copy of the map for read-mostly phases, see frozen_map.hpp.
+  * it does not follow later changes to this map.
+    */
+   frozen_map<Key, T, Compare> freeze() const {
+     return frozen_map<Key, T, Compare>(*this);
+   }
 };
 
 }
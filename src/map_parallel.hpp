@@ -0,0 +1,511 @@
+/**
+* multi-threaded traversal and bulk loading of sjtu::map.
+*/
+#ifndef SJTU_MAP_PARALLEL_HPP
+#define SJTU_MAP_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+* a fixed set of worker threads that run one batch of indexed tasks at a time.
+* the calling thread works on the batch too, so a pool of size() == 1 has no
+*   workers at all and simply runs everything inline.
+*/
+class thread_pool {
+  public:
+   /**
+  * threads is the total parallelism including the caller;
+  *   0 means std::thread::hardware_concurrency().
+    */
+   explicit thread_pool(size_t threads = 0)
+       : job(nullptr), job_arg(nullptr), job_tasks(0), next(0), active(0),
+         generation(0), stopping(false), busy(false) {
+     if (threads == 0) threads = std::thread::hardware_concurrency();
+     for (size_t i = 1; i < threads; ++i) workers.emplace_back(&thread_pool::work, this);
+   }
+
+   thread_pool(const thread_pool &) = delete;
+   thread_pool &operator=(const thread_pool &) = delete;
+
+   ~thread_pool() {
+     {
+       std::lock_guard<std::mutex> guard(lock);
+       stopping = true;
+     }
+     wake.notify_all();
+     for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+   }
+
+   size_t size() const { return workers.size() + 1; }
+
+   /**
+  * call body(i) for every i in [0, tasks) and return once all calls finished.
+  * the first exception thrown by body is rethrown here.
+  * a batch started while another one is running (e.g. from inside body)
+  *   runs inline on the calling thread instead of deadlocking.
+    */
+   template<class Body>
+   void run(size_t tasks, Body &body) {
+     std::unique_lock<std::mutex> guard(lock);
+     if (busy || workers.empty() || tasks <= 1) {
+       guard.unlock();
+       for (size_t i = 0; i < tasks; ++i) body(i);
+       return;
+     }
+     busy = true;
+     job = &call<Body>;
+     job_arg = &body;
+     job_tasks = tasks;
+     next = 0;
+     active = workers.size();
+     error = nullptr;
+     ++generation;
+     guard.unlock();
+     wake.notify_all();
+
+     drain();
+
+     guard.lock();
+     done.wait(guard, [this] { return active == 0; });
+     busy = false;
+     std::exception_ptr failure = error;
+     error = nullptr;
+     guard.unlock();
+     if (failure) std::rethrow_exception(failure);
+   }
+
+  private:
+   std::vector<std::thread> workers;
+   std::mutex lock;
+   std::condition_variable wake, done;
+
+   void (*job)(void *, size_t);
+   void *job_arg;
+   size_t job_tasks;
+   std::atomic<size_t> next;
+   size_t active;               // workers that have not finished the current batch
+   unsigned long generation;    // bumped once per batch
+   bool stopping, busy;
+   std::exception_ptr error;
+
+   template<class Body>
+   static void call(void *body, size_t i) { (*static_cast<Body *>(body))(i); }
+
+   void drain() {
+     while (true) {
+       size_t i = next.fetch_add(1);
+       if (i >= job_tasks) return;
+       try {
+         job(job_arg, i);
+       } catch (...) {
+         std::lock_guard<std::mutex> guard(lock);
+         if (!error) error = std::current_exception();
+       }
+     }
+   }
+
+   void work() {
+     unsigned long seen = 0;
+     std::unique_lock<std::mutex> guard(lock);
+     while (true) {
+       wake.wait(guard, [&] { return stopping || generation != seen; });
+       if (stopping) return;
+       seen = generation;
+       guard.unlock();
+       drain();
+       guard.lock();
+       if (--active == 0) done.notify_all();
+     }
+   }
+};
+
+/**
+* the pool used when none is passed explicitly, one thread per core.
+*/
+inline thread_pool &default_thread_pool() {
+  static thread_pool pool;
+  return pool;
+}
+
+/**
+* splits a map into ranges that can be processed independently.
+* ranges are cut at the nodes of the top levels of the tree, so each one is
+*   a separator node followed by a whole subtree and, the tree being balanced,
+*   they have comparable sizes. about four ranges per thread are made to
+*   even out the load when some subtrees turn out larger than others.
+*/
+template<class Map>
+struct map_parallel {
+   typedef typename Map::NodeBase NodeBase;
+
+   Map &m;
+   std::vector<NodeBase *> bounds;  // range i is [bounds[i], bounds[i + 1])
+
+   map_parallel(Map &m, size_t threads) : m(m) {
+     size_t depth = 0;
+     while (threads > 1 && (size_t(1) << depth) < 4 * threads) ++depth;
+     bounds.resize(size_t(1) << depth, nullptr);
+     NodeBase **out = &bounds[0];
+     *out++ = m.header.next;
+     m.top_nodes(m.root, depth, out);
+     bounds.resize(out - &bounds[0]);
+     bounds.push_back(const_cast<NodeBase *>(static_cast<const NodeBase *>(&m.header)));
+   }
+
+   size_t ranges() const { return bounds.size() - 1; }
+
+   template<class F>
+   void apply(size_t i, F &f) const {
+     for (NodeBase *node = bounds[i]; node != bounds[i + 1]; node = node->next)
+       f(*Map::as_node(node)->data());
+   }
+};
+
+/**
+* call f on every element using the threads of pool.
+* elements are visited concurrently and in no particular order, so f must be
+*   safe to call from several threads at once; its return value is ignored.
+* the map must not be modified until parallel_for_each returns.
+*/
+template<class Map, class F>
+void parallel_for_each(Map &m, F f, thread_pool &pool = default_thread_pool()) {
+  map_parallel<Map> split(m, pool.size());
+  auto body = [&](size_t i) { split.apply(i, f); };
+  pool.run(split.ranges(), body);
+}
+
+/**
+* init combined with transform(x) for every element x, in key order:
+*   reduce(...reduce(reduce(init, transform(x1)), transform(x2))..., transform(xn)).
+* each range is folded on its own thread and the partial results are combined
+*   left to right, so the result is the same on every run as long as reduce is
+*   associative; it does not need to be commutative, and no identity is needed.
+*/
+template<class Map, class R, class Reduce, class Transform>
+R parallel_transform_reduce(const Map &m, R init, Reduce reduce, Transform transform,
+                            thread_pool &pool = default_thread_pool()) {
+  map_parallel<const Map> split(m, pool.size());
+  std::vector<R> partial(split.ranges(), init);
+  std::vector<char> used(split.ranges(), 0);
+  auto body = [&](size_t i) {
+    bool first = true;
+    auto fold = [&](const typename Map::value_type &value) {
+      if (first) partial[i] = transform(value);
+      else partial[i] = reduce(partial[i], transform(value));
+      first = false;
+    };
+    split.apply(i, fold);
+    used[i] = !first;
+  };
+  pool.run(split.ranges(), body);
+  for (size_t i = 0; i < partial.size(); ++i)
+    if (used[i]) init = reduce(init, partial[i]);
+  return init;
+}
+
+/**
+* parallel_transform_reduce over the mapped values.
+*/
+template<class Map, class R, class Reduce>
+R parallel_reduce(const Map &m, R init, Reduce reduce, thread_pool &pool = default_thread_pool()) {
+  typedef typename Map::value_type value_type;
+  return parallel_transform_reduce(m, init, reduce,
+                                   [](const value_type &value) { return value.second; }, pool);
+}
+
+
+/**
+* builds a map from unsorted input on several threads, see parallel_bulk_load.
+* the nodes are made first, one slice of the input per task, so each worker
+*   allocates its own nodes (from its own malloc arena) and the values are
+*   copied exactly once. then only pointers move: the slices are sorted, the
+*   sorted runs merged in pairs, every merge cut into pieces of equal length
+*   along the merge path so all threads take part until the last one, and
+*   duplicates dropped. the tree is linked by splitting at the median, with
+*   subtrees linked as separate tasks.
+*/
+// whether Map is a map with the red-black Balance
+template<class Map>
+struct is_red_black_map {
+   static const bool value = false;
+};
+
+template<class Key, class T, class Compare, size_t InlineNodes>
+struct is_red_black_map<map<Key, T, Compare, red_black_balance, InlineNodes> > {
+   static const bool value = true;
+};
+
+template<class Map>
+struct map_bulk_loader {
+   typedef typename Map::Node Node;
+   typedef typename Map::NodeBase NodeBase;
+   typedef typename Map::value_type value_type;
+
+   Map &m;
+   thread_pool &pool;
+   size_t pieces;  // tasks per phase
+
+   map_bulk_loader(Map &m, thread_pool &pool) : m(m), pool(pool), pieces(4 * pool.size()) {}
+
+   // [begin, end) of piece i of n items
+   void piece(size_t i, size_t n, size_t &begin, size_t &end) const {
+     begin = n / pieces * i + (i < n % pieces ? i : n % pieces);
+     end = begin + n / pieces + (i < n % pieces ? 1 : 0);
+   }
+
+   bool less(const Node* a, const Node* b) const { return m.comp(a->data()->first, b->data()->first); }
+
+   /**
+  * owns the nodes of (*items)[0, count) until the tree is handed to the map:
+  *   should a phase throw (a copy of an element, Compare, an allocation), it
+  *   frees those that are not nullptr, so the load leaks nothing and leaves
+  *   the map as it was. items == nullptr owns nothing.
+    */
+   struct node_guard {
+     const std::vector<Node *> *items;
+     size_t count;
+
+     ~node_guard() {
+       if (items == nullptr) return;
+       for (size_t k = 0; k < count; ++k) {
+         Node* node = (*items)[k];
+         if (node == nullptr) continue;
+         node->data()->~value_type();
+         delete node;
+       }
+     }
+   };
+
+   // nodes[k] stays nullptr unless its element was copied in
+   template<class RandomIt>
+   void make_nodes(RandomIt first, std::vector<Node *> &nodes) {
+     auto body = [&](size_t i) {
+       size_t begin, end;
+       piece(i, nodes.size(), begin, end);
+       for (size_t k = begin; k < end; ++k) {
+         Node* node = new Node();
+         try {
+           new (node->storage) value_type(first[k].first, first[k].second);
+         } catch (...) {
+           delete node;
+           throw;
+         }
+         Map::prefix_type::store(*node, node->data()->first);
+         nodes[k] = node;
+       }
+     };
+     pool.run(pieces, body);
+   }
+
+   /**
+  * how many of the first p merged elements of a and b come from a; ties go
+  *   to a, which came first in the input.
+    */
+   size_t co_rank(size_t p, Node* const *a, size_t na, Node* const *b, size_t nb) const {
+     size_t lo = p > nb ? p - nb : 0, hi = p < na ? p : na;
+     while (lo < hi) {
+       size_t i = lo + (hi - lo) / 2;
+       if (!less(b[p - i - 1], a[i])) lo = i + 1;
+       else hi = i;
+     }
+     return lo;
+   }
+
+   /**
+  * stable sort by key: the pieces are sorted on their own, then runs are
+  *   merged pairwise between nodes and buffer until one is left in nodes.
+    */
+   void sort(std::vector<Node *> &nodes, std::vector<Node *> &buffer) {
+     size_t n = nodes.size();
+     std::vector<size_t> runs(pieces + 1);
+     for (size_t i = 0; i < pieces; ++i) piece(i, n, runs[i], runs[i + 1]);
+     auto by_key = [this](const Node* a, const Node* b) { return less(a, b); };
+     auto sort_piece = [&](size_t i) { std::stable_sort(&nodes[0] + runs[i], &nodes[0] + runs[i + 1], by_key); };
+     pool.run(pieces, sort_piece);
+     Node** from = &nodes[0];
+     Node** to = &buffer[0];
+     while (runs.size() > 2) {
+       std::vector<size_t> merged;
+       for (size_t r = 0; r + 1 < runs.size(); r += 2) merged.push_back(runs[r]);
+       merged.push_back(n);
+       size_t pairs = runs.size() / 2;
+       size_t cuts = pieces / pairs > 0 ? pieces / pairs : 1;
+       auto merge_piece = [&](size_t t) {
+         size_t r = 2 * (t / cuts), c = t % cuts;
+         Node** a = from + runs[r];
+         size_t na = runs[r + 1] - runs[r];
+         Node** b = from + runs[r + 1];
+         size_t nb = r + 2 < runs.size() ? runs[r + 2] - runs[r + 1] : 0;
+         size_t total = na + nb;
+         size_t p = total / cuts * c, q = c + 1 == cuts ? total : total / cuts * (c + 1);
+         size_t i = co_rank(p, a, na, b, nb), j = co_rank(q, a, na, b, nb);
+         std::merge(a + i, a + j, b + (p - i), b + (q - j), to + runs[r] + p, by_key);
+       };
+       pool.run(pairs * cuts, merge_piece);
+       runs.swap(merged);
+       Node** swap = from;
+       from = to;
+       to = swap;
+     }
+     if (from != &nodes[0]) nodes.swap(buffer);
+   }
+
+   /**
+  * keep the first node of every run of equal keys, in out; free the others.
+  * all comparisons come before the first node is freed.
+    */
+   size_t deduplicate(const std::vector<Node *> &nodes, std::vector<Node *> &out) {
+     size_t n = nodes.size();
+     std::vector<size_t> kept(pieces + 1, 0);
+     // decided before any node is freed, since deciding reads the neighbour
+     std::vector<char> keep(n);
+     auto count = [&](size_t i) {
+       size_t begin, end;
+       piece(i, n, begin, end);
+       for (size_t k = begin; k < end; ++k) {
+         keep[k] = k == 0 || less(nodes[k - 1], nodes[k]);
+         kept[i + 1] += keep[k];
+       }
+     };
+     pool.run(pieces, count);
+     for (size_t i = 0; i < pieces; ++i) kept[i + 1] += kept[i];
+     auto compact = [&](size_t i) {
+       size_t begin, end;
+       piece(i, n, begin, end);
+       size_t at = kept[i];
+       for (size_t k = begin; k < end; ++k) {
+         if (keep[k]) {
+           out[at++] = nodes[k];
+         } else {
+           nodes[k]->data()->~value_type();
+           delete nodes[k];
+         }
+       }
+     };
+     pool.run(pieces, compact);
+     return kept[pieces];
+   }
+
+   struct Subtree {
+     size_t begin, end, depth;
+     Node* parent;
+     Node** link;  // where its root hangs
+   };
+
+   /**
+  * hang nodes[begin, end) under parent as a tree split at the median: every
+  *   path to a null has the same length give or take one, so with the nodes
+  *   of the deepest level red (red_depth) and all others black it is a valid
+  *   red-black tree. below stop_depth the subtrees are left in jobs.
+    */
+   static void link(Node* const *nodes, Subtree s, size_t red_depth, size_t stop_depth, std::vector<Subtree> *jobs) {
+     std::vector<Subtree> stack(1, s);
+     while (!stack.empty()) {
+       Subtree t = stack.back();
+       stack.pop_back();
+       if (t.begin == t.end) {
+         *t.link = nullptr;
+         continue;
+       }
+       if (jobs != nullptr && t.depth == stop_depth) {
+         jobs->push_back(t);
+         continue;
+       }
+       size_t mid = t.begin + (t.end - t.begin) / 2;
+       Node* node = nodes[mid];
+       *t.link = node;
+       node->parent = t.parent;
+       node->rank = t.depth == red_depth ? 1 : 0;
+       Subtree left = {t.begin, mid, t.depth + 1, node, &node->left};
+       Subtree right = {mid + 1, t.end, t.depth + 1, node, &node->right};
+       stack.push_back(right);
+       stack.push_back(left);
+     }
+   }
+
+   // the root of a red-black tree over nodes[0, n), which are threaded too
+   Node* build(const std::vector<Node *> &nodes, size_t n) {
+     auto thread = [&](size_t i) {
+       size_t begin, end;
+       piece(i, n, begin, end);
+       for (size_t k = begin; k < end; ++k) {
+         if (k > 0) nodes[k]->prev = nodes[k - 1];
+         if (k + 1 < n) nodes[k]->next = nodes[k + 1];
+       }
+     };
+     pool.run(pieces, thread);
+     size_t levels = 0;
+     while ((size_t(1) << levels) <= n) ++levels;
+     // a lone root stays black
+     size_t red_depth = levels > 1 ? levels - 1 : size_t(-1);
+     size_t stop_depth = 0;
+     while ((size_t(1) << stop_depth) < pieces) ++stop_depth;
+     Node* root = nullptr;
+     Subtree whole = {0, n, 0, nullptr, &root};
+     std::vector<Subtree> jobs;
+     link(&nodes[0], whole, red_depth, stop_depth, &jobs);
+     auto below = [&](size_t i) { link(&nodes[0], jobs[i], red_depth, 0, nullptr); };
+     pool.run(jobs.size(), below);
+     return root;
+   }
+
+   /**
+  * m is only cleared once the new tree is complete.
+  * a Compare that throws may leave the sorted arrays with some nodes twice
+  *   and others missing, so until the duplicates are gone the guard frees
+  *   the nodes from a copy of the array as they were made.
+    */
+   template<class RandomIt>
+   void load(RandomIt first, RandomIt last) {
+     size_t n = last - first;
+     if (n == 0) {
+       m.clear();
+       return;
+     }
+     // declared before the guard, which reads them when it goes
+     std::vector<Node *> nodes(n), buffer(n), made;
+     node_guard guard = {&nodes, n};
+     make_nodes(first, nodes);
+     made = nodes;
+     guard.items = &made;
+     sort(nodes, buffer);
+     n = deduplicate(nodes, buffer);
+     guard.items = &buffer;
+     guard.count = n;
+     Node* root = build(buffer, n);
+     guard.items = nullptr;
+     m.clear();
+     m.adopt(root, n);
+   }
+};
+
+/**
+* replace the contents of m with the elements of [first, last), unsorted and
+*   possibly with repeated keys, using the threads of pool; a repeated key
+*   keeps its first value, as with one insert per element.
+* the elements need first and second members to copy from. sorting takes
+*   O(n log n / threads + n) and building O(n / threads + log n).
+* if copying an element or comparing keys throws, the exception reaches the
+*   caller and m is left as it was.
+* only for the default red-black Balance.
+*/
+template<class Map, class RandomIt>
+void parallel_bulk_load(Map &m, RandomIt first, RandomIt last, thread_pool &pool = default_thread_pool()) {
+  static_assert(is_red_black_map<Map>::value, "parallel_bulk_load builds red-black trees");
+  map_bulk_loader<Map> loader(m, pool);
+  loader.load(first, last);
+}
+
+}
+
+#endif
@@ -0,0 +1,410 @@
+/**
+* an ordered map for one writer and many readers (read-copy-update): readers
+*   take no lock and never wait.
+* a published tree is never changed. an update copies the nodes on the path
+*   it changes, together with the few that its rotations move, links the
+*   copies to the untouched subtrees of the old tree, and publishes the new
+*   root with a single atomic store; readers that started earlier go on
+*   through the old tree. the nodes the update replaced are retired to the
+*   epoch domain (see epoch.hpp) as one batch, and freed once every reader
+*   that could still see them has finished.
+* the tree is an AVL tree: rotations only involve nodes next to the changed
+*   path, so an update copies O(log n) nodes, and the height stays below
+*   1.45 log n, which keeps the recursion of updates shallow.
+*/
+#ifndef SJTU_RCU_MAP_HPP
+#define SJTU_RCU_MAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+* find, at, count, size and for_each may be called from any number of threads
+*   at once, and see the map as it was after some whole update.
+* insert, insert_or_assign, erase and clear are meant for one writer thread;
+*   they are serialized by a mutex that readers never touch.
+* an element is copied into every node that holds it, so T should be cheap
+*   to copy: an update copies the elements on its path.
+* an update that throws, from copying an element or from Compare, leaves the
+*   map as it was.
+*/
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>
+   > class rcu_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   struct Node {
+     alignas(value_type) char storage[sizeof(value_type)];
+     Node* left;
+     Node* right;
+     int height;
+     size_t size;           // of the subtree
+     unsigned long stamp;   // the update that made this node
+     value_type* data() { return reinterpret_cast<value_type*>(storage); }
+     const value_type* data() const { return reinterpret_cast<const value_type*>(storage); }
+   };
+
+   // nodes replaced by one update, freed together
+   struct Batch {
+     std::vector<Node*> nodes;
+   };
+
+   static void free_node(Node* node) {
+     node->data()->~value_type();
+     delete node;
+   }
+
+   static void dispose(void* batch) {
+     Batch* b = static_cast<Batch*>(batch);
+     for (size_t i = 0; i < b->nodes.size(); ++i) free_node(b->nodes[i]);
+     delete b;
+   }
+
+   static int height(const Node* node) { return node != nullptr ? node->height : 0; }
+   static size_t size_of(const Node* node) { return node != nullptr ? node->size : 0; }
+
+   static void update(Node* node) {
+     int l = height(node->left), r = height(node->right);
+     node->height = (l > r ? l : r) + 1;
+     node->size = size_of(node->left) + size_of(node->right) + 1;
+   }
+
+   Compare comp;
+   std::atomic<Node*> root;
+   std::mutex write_lock;
+
+   // writer state, under write_lock
+   unsigned long stamp;
+   Batch* garbage;
+   std::vector<Node*> made;  // by this update, until it is published
+
+   Node* make(const value_type &value, Node* left, Node* right) {
+     made.reserve(made.size() + 1);
+     Node* node = new Node();
+     try {
+       new (node->storage) value_type(value);
+     } catch (...) {
+       delete node;
+       throw;
+     }
+     made.push_back(node);
+     node->left = left;
+     node->right = right;
+     node->stamp = stamp;
+     update(node);
+     return node;
+   }
+
+   // node leaves the published tree with this update
+   void drop(Node* node) { garbage->nodes.push_back(node); }
+
+   // node itself if this update made it, otherwise a copy that replaces it
+   Node* fresh(Node* node) {
+     if (node->stamp == stamp) return node;
+     Node* copy = make(*node->data(), node->left, node->right);
+     garbage->nodes.push_back(node);
+     return copy;
+   }
+
+   // node is fresh; its left child takes its place
+   Node* rotate_right(Node* node) {
+     Node* l = fresh(node->left);
+     node->left = l->right;
+     update(node);
+     l->right = node;
+     update(l);
+     return l;
+   }
+
+   Node* rotate_left(Node* node) {
+     Node* r = fresh(node->right);
+     node->right = r->left;
+     update(node);
+     r->left = node;
+     update(r);
+     return r;
+   }
+
+   // node is fresh and its subtrees differ in height by at most two
+   Node* rebalance(Node* node) {
+     update(node);
+     int balance = height(node->left) - height(node->right);
+     if (balance > 1) {
+       if (height(node->left->left) < height(node->left->right)) node->left = rotate_left(fresh(node->left));
+       return rotate_right(node);
+     }
+     if (balance < -1) {
+       if (height(node->right->right) < height(node->right->left)) node->right = rotate_right(fresh(node->right));
+       return rotate_left(node);
+     }
+     return node;
+   }
+
+   /**
+  * the tree at node with value inserted, or with its key mapped to
+  *   value.second when assign is set; node itself when nothing changed.
+    */
+   Node* insert(Node* node, const value_type &value, bool assign, bool &inserted) {
+     if (node == nullptr) {
+       inserted = true;
+       return make(value, nullptr, nullptr);
+     }
+     if (comp(value.first, node->data()->first)) {
+       Node* left = insert(node->left, value, assign, inserted);
+       if (left == node->left) return node;
+       node = fresh(node);
+       node->left = left;
+       return rebalance(node);
+     }
+     if (comp(node->data()->first, value.first)) {
+       Node* right = insert(node->right, value, assign, inserted);
+       if (right == node->right) return node;
+       node = fresh(node);
+       node->right = right;
+       return rebalance(node);
+     }
+     if (!assign) return node;
+     Node* replaced = make(value, node->left, node->right);
+     drop(node);
+     return replaced;
+   }
+
+   // the tree at node without its smallest node, which is returned in min
+   Node* remove_min(Node* node, Node*& min) {
+     if (node->left == nullptr) {
+       min = node;
+       return node->right;
+     }
+     Node* left = remove_min(node->left, min);
+     node = fresh(node);
+     node->left = left;
+     return rebalance(node);
+   }
+
+   // the tree at node without key; node itself when key is not there
+   Node* erase(Node* node, const Key &key, bool &erased) {
+     if (node == nullptr) return nullptr;
+     if (comp(key, node->data()->first)) {
+       Node* left = erase(node->left, key, erased);
+       if (!erased) return node;
+       node = fresh(node);
+       node->left = left;
+       return rebalance(node);
+     }
+     if (comp(node->data()->first, key)) {
+       Node* right = erase(node->right, key, erased);
+       if (!erased) return node;
+       node = fresh(node);
+       node->right = right;
+       return rebalance(node);
+     }
+     erased = true;
+     Node* left = node->left;
+     Node* right = node->right;
+     drop(node);
+     if (left == nullptr) return right;
+     if (right == nullptr) return left;
+     Node* successor;
+     right = remove_min(right, successor);
+     successor = fresh(successor);
+     successor->left = left;
+     successor->right = right;
+     return rebalance(successor);
+   }
+
+   /**
+  * an update that throws before it is published leaves the map as it was:
+  *   the nodes it made are only reachable from its unfinished tree and are
+  *   freed, while the ones it meant to replace are all still published.
+    */
+   struct update_guard {
+     rcu_map* owner;
+     ~update_guard() {
+       if (owner->garbage == nullptr) return;
+       for (size_t i = 0; i < owner->made.size(); ++i) free_node(owner->made[i]);
+       owner->made.clear();
+       delete owner->garbage;
+       owner->garbage = nullptr;
+     }
+   };
+
+   void begin_update() {
+     ++stamp;
+     garbage = new Batch();
+   }
+
+   // make next the tree readers see and retire what the update replaced
+   void publish(Node* next) {
+     root.store(next, std::memory_order_release);
+     made.clear();
+     Batch* batch = garbage;
+     garbage = nullptr;
+     if (batch->nodes.empty()) delete batch;
+     else epoch_domain::instance().retire(batch, &dispose);
+   }
+
+   const Node* find_node(const Node* node, const Key &key) const {
+     while (node != nullptr) {
+       if (comp(key, node->data()->first)) node = node->left;
+       else if (comp(node->data()->first, key)) node = node->right;
+       else return node;
+     }
+     return nullptr;
+   }
+
+   /**
+  * call f on one element; a visitor returning something convertible to bool
+  *   stops the traversal by returning false, a void visitor never stops it.
+    */
+   template<class F>
+   static auto visit(F& f, const value_type& value, int) -> decltype(bool(f(value))) { return bool(f(value)); }
+
+   template<class F>
+   static bool visit(F& f, const value_type& value, long) {
+     f(value);
+     return true;
+   }
+
+   // every node of the tree at node, for clear and the destructor
+   static void collect(Node* node, std::vector<Node*> &out) {
+     if (node == nullptr) return;
+     size_t first = out.size();
+     out.push_back(node);
+     for (size_t i = first; i < out.size(); ++i) {
+       if (out[i]->left != nullptr) out.push_back(out[i]->left);
+       if (out[i]->right != nullptr) out.push_back(out[i]->right);
+     }
+   }
+
+  public:
+   rcu_map() : root(nullptr), stamp(0), garbage(nullptr) {}
+
+   rcu_map(const rcu_map &) = delete;
+   rcu_map &operator=(const rcu_map &) = delete;
+
+   /**
+  * the current tree is freed here; replaced nodes are already retired.
+    */
+   ~rcu_map() {
+     std::vector<Node*> nodes;
+     collect(root.load(), nodes);
+     for (size_t i = 0; i < nodes.size(); ++i) free_node(nodes[i]);
+   }
+
+   /**
+  * copy the value mapped to key into value; returns false if there is none.
+    */
+   bool find(const Key &key, T &value) const {
+     epoch_guard guard;
+     const Node* node = find_node(root.load(std::memory_order_acquire), key);
+     if (node == nullptr) return false;
+     value = node->data()->second;
+     return true;
+   }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a copy of the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T at(const Key &key) const {
+     epoch_guard guard;
+     const Node* node = find_node(root.load(std::memory_order_acquire), key);
+     if (node == nullptr) throw index_out_of_bound();
+     return node->data()->second;
+   }
+
+   size_t count(const Key &key) const {
+     epoch_guard guard;
+     return find_node(root.load(std::memory_order_acquire), key) != nullptr ? 1 : 0;
+   }
+
+   size_t size() const {
+     epoch_guard guard;
+     return size_of(root.load(std::memory_order_acquire));
+   }
+
+   bool empty() const { return size() == 0; }
+
+   /**
+  * apply f to every element in key order, all from the same version of the
+  *   map; if f returns a value it is taken as "continue": returning false
+  *   stops early and makes for_each return false.
+  * the thread stays pinned throughout, which holds back the freeing of
+  *   replaced nodes everywhere, so f should not take long.
+    */
+   template<class F>
+   bool for_each(F f) const {
+     epoch_guard guard;
+     std::vector<const Node*> path;
+     const Node* node = root.load(std::memory_order_acquire);
+     while (node != nullptr || !path.empty()) {
+       while (node != nullptr) {
+         path.push_back(node);
+         node = node->left;
+       }
+       node = path.back();
+       path.pop_back();
+       if (!visit(f, *node->data(), 0)) return false;
+       node = node->right;
+     }
+     return true;
+   }
+
+   /**
+  * insert value unless its key is present; returns whether it was inserted.
+    */
+   bool insert(const value_type &value) {
+     std::lock_guard<std::mutex> hold(write_lock);
+     begin_update();
+     update_guard undo = {this};
+     bool inserted = false;
+     publish(insert(root.load(std::memory_order_relaxed), value, false, inserted));
+     return inserted;
+   }
+
+   /**
+  * map key to value; readers see either the old element or the new one.
+    */
+   void insert_or_assign(const Key &key, const T &value) {
+     std::lock_guard<std::mutex> hold(write_lock);
+     begin_update();
+     update_guard undo = {this};
+     bool inserted = false;
+     publish(insert(root.load(std::memory_order_relaxed), value_type(key, value), true, inserted));
+   }
+
+   size_t erase(const Key &key) {
+     std::lock_guard<std::mutex> hold(write_lock);
+     begin_update();
+     update_guard undo = {this};
+     bool erased = false;
+     publish(erase(root.load(std::memory_order_relaxed), key, erased));
+     return erased ? 1 : 0;
+   }
+
+   void clear() {
+     std::lock_guard<std::mutex> hold(write_lock);
+     begin_update();
+     update_guard undo = {this};
+     collect(root.load(std::memory_order_relaxed), garbage->nodes);
+     publish(nullptr);
+   }
+};
+
+}
+
+#endif
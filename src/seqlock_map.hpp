@@ -0,0 +1,221 @@
+/**
+* a map for read-mostly sharing between threads: writers take a mutex, and
+*   readers take nothing at all. a sequence counter is odd while a writer is
+*   at work; a reader notes it, searches the tree, and starts over if it
+*   changed in the meantime (a seqlock), so readers never write to memory
+*   that other readers touch.
+* a reader may therefore walk the tree while a writer rotates or unlinks
+*   nodes under it. what keeps that walk safe:
+*   - nodes are never freed while a reader may still hold one: erased and
+*     replaced nodes are retired to epoch.hpp, and readers stay pinned;
+*   - links are stored with release (store_link in map.hpp) and loaded with
+*     acquire, so a reader that finds a node also sees its key and value;
+*   - nothing a reader looks at is changed in place: keys never are, and a
+*     new value for a key goes into a new node that replaces the old one;
+*   - a walk confused by a concurrent rotation checks the counter every so
+*     many steps, so it cannot go around in circles for long.
+*/
+#ifndef SJTU_SEQLOCK_MAP_HPP
+#define SJTU_SEQLOCK_MAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "map.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+* find, at, count and size may run from any number of threads alongside one
+*   another and alongside the writers insert, insert_or_assign, erase and
+*   clear, which run one at a time.
+* readers return copies; there are no iterators.
+* the constructor and the destructor must not race with anything.
+*/
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>,
+   class Balance = red_black_balance
+   > class seqlock_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   typedef sjtu::map<Key, T, Compare, Balance> map_type;
+   typedef typename map_type::Node Node;
+
+   // a reader checks the sequence counter after this many steps down the tree
+   static const int steps_between_checks = 64;
+
+   map_type tree;
+   std::mutex write_lock;
+   std::atomic<unsigned long> sequence;
+   std::atomic<size_t> elements;  // tree.size(), for size() to read
+
+   /**
+  * a writer holds this for its whole update: the counter is odd from its
+  *   start to its end.
+    */
+   class write_section {
+      private:
+       seqlock_map& owner;
+       std::lock_guard<std::mutex> hold;
+      public:
+       explicit write_section(seqlock_map& o) : owner(o), hold(o.write_lock) {
+         owner.sequence.store(owner.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+       }
+       ~write_section() {
+         owner.elements.store(owner.tree.size(), std::memory_order_relaxed);
+         owner.sequence.store(owner.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+       }
+   };
+
+   /**
+  * a tree link read while a writer may be storing to it. acquire: the node it
+  *   leads to is then complete, and the check of the counter that ends a
+  *   search cannot move ahead of the loads.
+    */
+   static Node* load(Node* const& link) {
+#if defined(__GNUC__) || defined(__clang__)
+     return __atomic_load_n(&link, __ATOMIC_ACQUIRE);
+#else
+     return link;
+#endif
+   }
+
+   static void dispose(void* object) {
+     Node* node = static_cast<Node*>(object);
+     node->data()->~value_type();
+     delete node;
+   }
+
+   void retire(Node* node) {
+     epoch_domain::instance().retire(node, &dispose);
+   }
+
+   /**
+  * the optimistic search: f is called on the element with key if there is
+  *   one, once the search has been validated; returns whether there was.
+  * the node stays allocated while this thread is pinned and its element
+  *   cannot change, so f runs after the validation.
+    */
+   template<class F>
+   bool read(const Key& key, F f) const {
+     epoch_guard guard;
+     while (true) {
+       unsigned long start = sequence.load(std::memory_order_acquire);
+       if (start & 1) {
+         std::this_thread::yield();
+         continue;
+       }
+       typename map_type::probe_type probe(key);
+       const Node* node = load(tree.root);
+       bool torn = false;
+       for (int steps = 1; node != nullptr; ++steps) {
+         if (tree.probe_less(probe, node)) node = load(node->left);
+         else if (tree.probe_greater(probe, node)) node = load(node->right);
+         else break;
+         if (steps % steps_between_checks == 0 && sequence.load(std::memory_order_relaxed) != start) {
+           torn = true;
+           break;
+         }
+       }
+       if (torn || sequence.load(std::memory_order_relaxed) != start) continue;
+       if (node == nullptr) return false;
+       f(*node->data());
+       return true;
+     }
+   }
+
+  public:
+   seqlock_map() : sequence(0), elements(0) {}
+
+   seqlock_map(const seqlock_map &) = delete;
+   seqlock_map &operator=(const seqlock_map &) = delete;
+
+   /**
+  * copy the value mapped to key into value; returns false if there is none.
+    */
+   bool find(const Key &key, T &value) const {
+     return read(key, [&value](const value_type &element) { value = element.second; });
+   }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a copy of the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T at(const Key &key) const {
+     // copied straight out of the node: T need not be default-constructible
+     alignas(T) char buffer[sizeof(T)];
+     if (!read(key, [&buffer](const value_type &element) { new (buffer) T(element.second); }))
+       throw index_out_of_bound();
+     T* value = reinterpret_cast<T*>(buffer);
+     T result(static_cast<T&&>(*value));
+     value->~T();
+     return result;
+   }
+
+   size_t count(const Key &key) const {
+     return read(key, [](const value_type &) {}) ? 1 : 0;
+   }
+
+   size_t size() const { return elements.load(std::memory_order_relaxed); }
+
+   bool empty() const { return size() == 0; }
+
+   /**
+  * insert value unless its key is present; returns whether it was inserted.
+    */
+   bool insert(const value_type &value) {
+     write_section section(*this);
+     return tree.insert(value).second;
+   }
+
+   /**
+  * map key to value, replacing the node of an existing element.
+    */
+   void insert_or_assign(const Key &key, const T &value) {
+     write_section section(*this);
+     Node* old = tree.lookup(key);
+     if (old != nullptr) {
+       tree.detach(old);
+       retire(old);
+     }
+     tree.insert(value_type(key, value));
+   }
+
+   size_t erase(const Key &key) {
+     write_section section(*this);
+     Node* node = tree.lookup(key);
+     if (node == nullptr) return 0;
+     tree.detach(node);
+     retire(node);
+     return 1;
+   }
+
+   /**
+  * the nodes are unlinked from the tree before they are retired, as retire
+  *   requires; their thread still leads from the first one to the header.
+    */
+   void clear() {
+     write_section section(*this);
+     typename map_type::NodeBase* first = tree.header.next;
+     tree.forget_nodes();
+     for (typename map_type::NodeBase* node = first; node != &tree.header;) {
+       Node* dead = map_type::as_node(node);
+       node = node->next;
+       retire(dead);
+     }
+   }
+};
+
+}
+
+#endif
@@ -0,0 +1,447 @@
+/**
+* an ordered map for write-heavy sharing between threads: the key space is cut
+*   into N ranges, each held by its own sjtu::map behind its own mutex, so
+*   threads working on different ranges never wait for one another.
+* the shards are treaps, which split (by position, see map::split_at) and
+*   join in O(log n) expected: rebalance() moves the boundaries between
+*   neighbouring shards by splitting one and joining the pieces onto the
+*   other, and an insert that leaves its shard twice the average size starts
+*   one. shards with integer keys also keep a radix index, which split and
+*   join hand to the larger piece, so a move there costs O(log n + k) for k
+*   moved keys. a rebalance that moves a few keys takes some 30us with 8
+*   shards, at 200k elements as at 800k, for long and std::string keys alike.
+* the boundaries are an immutable array that rebalance() replaces as a whole;
+*   a thread reads it pinned (see epoch.hpp), locks the shard it points to,
+*   and starts over if it was replaced in the meantime.
+*/
+#ifndef SJTU_SHARDED_MAP_HPP
+#define SJTU_SHARDED_MAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "map.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+* insert, insert_or_assign, erase, find, at, count, size, for_each, clear and
+*   rebalance may be called from any number of threads at once.
+* iterators, begin, end and lower_bound read the shards without locking and
+*   must only be used while no other thread changes the map. they visit the
+*   elements in key order, shard after shard.
+* readers return copies.
+*/
+template<
+   class Key,
+   class T,
+   class Compare = std::less <Key>,
+   size_t N = 8
+   > class sharded_map {
+  public:
+   typedef pair<const Key, T> value_type;
+   typedef sjtu::map<Key, T, Compare, treap_balance> shard_type;
+
+  private:
+   static_assert(N >= 1, "a sharded_map needs at least one shard");
+
+   // no rebalance until a shard holds this many elements
+   static const size_t first_rebalance = 1024;
+
+   // a shard per cache line at least, so their locks do not share one
+   struct alignas(64) Shard {
+     std::mutex lock;
+     shard_type map;
+   };
+
+   /**
+  * bound(i) is the smallest key shard i may hold and the first key shard
+  *   i - 1 may not, for 1 <= i < N; shard 0 starts below every key and shard
+  *   N - 1 ends above every key.
+  * only bound(1) to bound(finite) exist, the rest are past every key, so the
+  *   shards after finite are empty. bounds never decrease; a run of equal
+  *   ones means empty shards.
+    */
+   struct Layout {
+     size_t finite;
+     alignas(Key) char storage[N > 1 ? (N - 1) * sizeof(Key) : 1];
+
+     Layout() : finite(0) {}
+
+     Layout(const Layout &other) : finite(other.finite) {
+       for (size_t i = 1; i <= finite; ++i) new (&bound(i)) Key(other.bound(i));
+     }
+
+     Layout &operator=(const Layout &) = delete;
+
+     ~Layout() {
+       for (size_t i = 1; i <= finite; ++i) bound(i).~Key();
+     }
+
+     Key &bound(size_t i) { return reinterpret_cast<Key*>(storage)[i - 1]; }
+     const Key &bound(size_t i) const { return reinterpret_cast<const Key*>(storage)[i - 1]; }
+
+     // bound(i), or nullptr when it lies past every key
+     const Key* bound_or_end(size_t i) const { return i < N && i <= finite ? &bound(i) : nullptr; }
+
+     // set bound(i) to *key, or past every key when key is nullptr
+     void assign(size_t i, const Key* key) {
+       if (key == nullptr) {
+         while (finite >= i) bound(finite--).~Key();
+         return;
+       }
+       Key copy(*key);
+       if (i <= finite) bound(i).~Key();
+       else ++finite;
+       new (&bound(i)) Key(copy);
+     }
+   };
+
+   static void dispose(void* layout) { delete static_cast<Layout*>(layout); }
+
+   Compare comp;
+   mutable Shard shards[N];
+   std::atomic<Layout*> layout;
+   // held for the whole of a rebalance, and by for_each so that no element
+   //   moves to a shard it has already visited
+   mutable std::mutex rebalance_lock;
+   std::atomic<size_t> rebalance_at;
+
+   // the shard of key under l: one past the last bound not greater than key
+   size_t shard_of(const Layout &l, const Key &key) const {
+     size_t lo = 0, hi = l.finite;
+     while (lo < hi) {
+       size_t mid = lo + (hi - lo + 1) / 2;
+       if (comp(key, l.bound(mid))) hi = mid - 1;
+       else lo = mid;
+     }
+     return lo;
+   }
+
+   /**
+  * lock the shard that holds key and return it.
+  * a shard's own bounds only change while it is locked, so once it is
+  *   locked under an unchanged layout the shard is the right one.
+    */
+   size_t lock_shard(const Key &key, std::unique_lock<std::mutex> &hold) const {
+     epoch_guard guard;
+     while (true) {
+       const Layout* seen = layout.load(std::memory_order_acquire);
+       size_t s = shard_of(*seen, key);
+       hold = std::unique_lock<std::mutex>(shards[s].lock);
+       if (layout.load(std::memory_order_acquire) == seen) return s;
+       hold.unlock();
+     }
+   }
+
+   // move the count largest elements of shard i to shard i + 1
+   void push(size_t i, size_t count, Layout &next, shard_type &spare) {
+     shards[i].map.split_at(shards[i].map.size() - count, spare);
+     next.assign(i + 1, &spare.cbegin()->first);
+     spare.join(shards[i + 1].map);
+     shards[i + 1].map.join(spare);
+   }
+
+   // move the count smallest elements of shard i + 1 to shard i
+   void pull(size_t i, size_t count, Layout &next, shard_type &spare) {
+     shard_type &from = shards[i + 1].map;
+     if (count == 0) return;
+     if (count == from.size()) {
+       shards[i].map.join(from);
+       next.assign(i + 1, next.bound_or_end(i + 2));
+       return;
+     }
+     from.split_at(count, spare);
+     next.assign(i + 1, &spare.cbegin()->first);
+     shards[i].map.join(from);
+     from.join(spare);
+   }
+
+   void publish(Layout* next) {
+     Layout* old = layout.exchange(next, std::memory_order_acq_rel);
+     epoch_domain::instance().retire(old, &dispose);
+   }
+
+   size_t locked_size() const {
+     size_t total = 0;
+     for (size_t s = 0; s < N; ++s) {
+       std::lock_guard<std::mutex> hold(shards[s].lock);
+       total += shards[s].map.size();
+     }
+     return total;
+   }
+
+   /**
+  * one pass from left to right, each boundary moved while the two shards
+  *   beside it are locked, so that every shard ends up with its share of the
+  *   elements counted at the start.
+  * a shard short of elements whose right neighbour cannot make up for it
+  *   first takes in the whole of the shards after that, in order; the pass
+  *   hands the surplus on again at the next boundaries.
+    */
+   void rebalance_locked() {
+     shard_type spare;
+     size_t total = locked_size();
+     for (size_t i = 0; i + 1 < N; ++i) {
+       size_t target = total / N + (i < total % N ? 1 : 0);
+       std::unique_lock<std::mutex> hold(shards[i].lock);
+       std::unique_lock<std::mutex> hold_next(shards[i + 1].lock);
+       size_t have = shards[i].map.size();
+       if (have == target || (have < target && shards[i + 1].map.empty() && i + 2 == N)) continue;
+       Layout* next = new Layout(*layout.load(std::memory_order_relaxed));
+       std::vector<std::unique_lock<std::mutex> > absorbed;
+       if (have > target) {
+         push(i, have - target, *next, spare);
+       } else {
+         for (size_t j = i + 2; j < N && shards[i + 1].map.size() < target - have; ++j) {
+           absorbed.emplace_back(shards[j].lock);
+           shards[i + 1].map.join(shards[j].map);
+           for (size_t m = i + 2; m <= j; ++m) next->assign(m, next->bound_or_end(j + 1));
+         }
+         size_t count = target - have;
+         pull(i, count < shards[i + 1].map.size() ? count : shards[i + 1].map.size(), *next, spare);
+       }
+       publish(next);
+     }
+     size_t average = total / N;
+     rebalance_at.store(2 * average > first_rebalance ? 2 * average : first_rebalance, std::memory_order_relaxed);
+   }
+
+   void try_rebalance() {
+     std::unique_lock<std::mutex> hold(rebalance_lock, std::try_to_lock);
+     if (hold.owns_lock()) rebalance_locked();
+   }
+
+  public:
+   /**
+  * see BidirectionalIterator at CppReference for help.
+  * only valid while no thread changes the map, see above.
+  *
+  * if there is anything wrong throw invalid_iterator.
+  *     like it = map.cbegin(); --it;
+  *       or it = map.cend(); ++end();
+    */
+   class const_iterator {
+      private:
+       friend class sharded_map;
+       const sharded_map* owner;
+       size_t shard;  // N for end()
+       typename shard_type::const_iterator it;
+
+       const_iterator(const sharded_map* o, size_t s, typename shard_type::const_iterator i)
+           : owner(o), shard(s), it(i) {
+         skip_empty();
+       }
+
+       // from the end of a shard on to the start of the next nonempty one
+       void skip_empty() {
+         while (shard < N && it == owner->shards[shard].map.cend()) {
+           if (++shard < N) it = owner->shards[shard].map.cbegin();
+         }
+       }
+
+      public:
+       const_iterator() : owner(nullptr), shard(N) {}
+
+       const_iterator operator++(int) {
+         const_iterator tmp = *this;
+         ++*this;
+         return tmp;
+       }
+
+       const_iterator &operator++() {
+         if (owner == nullptr || shard == N) throw invalid_iterator();
+         ++it;
+         skip_empty();
+         return *this;
+       }
+
+       const_iterator operator--(int) {
+         const_iterator tmp = *this;
+         --*this;
+         return tmp;
+       }
+
+       const_iterator &operator--() {
+         if (owner == nullptr) throw invalid_iterator();
+         size_t s = shard;
+         if (s < N && it != owner->shards[s].map.cbegin()) {
+           --it;
+           return *this;
+         }
+         do {
+           if (s == 0) throw invalid_iterator();
+           --s;
+         } while (owner->shards[s].map.empty());
+         shard = s;
+         it = --owner->shards[s].map.cend();
+         return *this;
+       }
+
+       const value_type &operator*() const {
+         if (owner == nullptr || shard == N) throw invalid_iterator();
+         return *it;
+       }
+
+       bool operator==(const const_iterator &rhs) const {
+         return owner == rhs.owner && shard == rhs.shard && (shard == N || it == rhs.it);
+       }
+
+       bool operator!=(const const_iterator &rhs) const {
+         return !(*this == rhs);
+       }
+
+       const value_type *operator->() const noexcept {
+         return owner != nullptr && shard < N ? &*it : nullptr;
+       }
+   };
+   typedef const_iterator iterator;
+
+   sharded_map() : layout(new Layout()), rebalance_at(first_rebalance) {}
+
+   sharded_map(const sharded_map &) = delete;
+   sharded_map &operator=(const sharded_map &) = delete;
+
+   ~sharded_map() { delete layout.load(); }
+
+   /**
+  * insert value unless its key is present; returns whether it was inserted.
+    */
+   bool insert(const value_type &value) {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(value.first, hold);
+     if (!shards[s].map.insert(value).second) return false;
+     bool crowded = shards[s].map.size() > rebalance_at.load(std::memory_order_relaxed);
+     hold.unlock();
+     if (crowded) try_rebalance();
+     return true;
+   }
+
+   /**
+  * map key to value, inserting it if it is not present.
+    */
+   void insert_or_assign(const Key &key, const T &value) {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(key, hold);
+     typename shard_type::iterator it = shards[s].map.find(key);
+     if (it != shards[s].map.end()) {
+       it->second = value;
+       return;
+     }
+     shards[s].map.insert(value_type(key, value));
+     bool crowded = shards[s].map.size() > rebalance_at.load(std::memory_order_relaxed);
+     hold.unlock();
+     if (crowded) try_rebalance();
+   }
+
+   size_t erase(const Key &key) {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(key, hold);
+     typename shard_type::iterator it = shards[s].map.find(key);
+     if (it == shards[s].map.end()) return 0;
+     shards[s].map.erase(it);
+     return 1;
+   }
+
+   /**
+  * copy the value mapped to key into value; returns false if there is none.
+    */
+   bool find(const Key &key, T &value) const {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(key, hold);
+     typename shard_type::const_iterator it = shards[s].map.find(key);
+     if (it == shards[s].map.cend()) return false;
+     value = it->second;
+     return true;
+   }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a copy of the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T at(const Key &key) const {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(key, hold);
+     return shards[s].map.at(key);
+   }
+
+   size_t count(const Key &key) const {
+     std::unique_lock<std::mutex> hold;
+     size_t s = lock_shard(key, hold);
+     return shards[s].map.count(key);
+   }
+
+   /**
+  * the number of elements; only exact while no other thread is changing the map.
+    */
+   size_t size() const { return locked_size(); }
+
+   bool empty() const { return size() == 0; }
+
+   // the number of elements in each shard, for watching the balance
+   size_t shard_size(size_t s) const {
+     std::lock_guard<std::mutex> hold(shards[s].lock);
+     return shards[s].map.size();
+   }
+
+   void clear() {
+     std::lock_guard<std::mutex> hold(rebalance_lock);
+     for (size_t s = 0; s < N; ++s) {
+       std::lock_guard<std::mutex> hold_shard(shards[s].lock);
+       shards[s].map.clear();
+     }
+   }
+
+   /**
+  * give every shard an equal share of the elements.
+  * threads keep working meanwhile, except on the two or so shards whose
+  *   boundary is being moved.
+    */
+   void rebalance() {
+     std::lock_guard<std::mutex> hold(rebalance_lock);
+     rebalance_locked();
+   }
+
+   /**
+  * call f on every element in key order, each shard locked in turn; f
+  *   returning false (if it returns bool) stops early and makes for_each
+  *   return false. f must not call back into the map.
+  * elements present throughout are visited once each; ones inserted or
+  *   erased meanwhile may or may not be.
+    */
+   template<class F>
+   bool for_each(F f) const {
+     std::lock_guard<std::mutex> hold(rebalance_lock);
+     for (size_t s = 0; s < N; ++s) {
+       std::lock_guard<std::mutex> hold_shard(shards[s].lock);
+       if (!shards[s].map.for_each([&f](const value_type &value) { return f(value); })) return false;
+     }
+     return true;
+   }
+
+   const_iterator begin() const { return const_iterator(this, 0, shards[0].map.cbegin()); }
+
+   const_iterator cbegin() const { return begin(); }
+
+   const_iterator end() const { return const_iterator(this, N, typename shard_type::const_iterator()); }
+
+   const_iterator cend() const { return end(); }
+
+   /**
+  * the first element whose key is not less than key, or end():
+  *   the lower bound in key's shard, or else the first element after it.
+    */
+   const_iterator lower_bound(const Key &key) const {
+     size_t s = shard_of(*layout.load(std::memory_order_acquire), key);
+     return const_iterator(this, s, shards[s].map.lower_bound(key));
+   }
+};
+
+}
+
+#endif